@@ -25,9 +25,11 @@
 #include "streams.h"
 
 #include <stdint.h>
+#include <cstring>
 
 #include <boost/filesystem.hpp>
 #include <iostream>
+#include <set>
 
 using namespace std;
 
@@ -69,6 +71,28 @@ int main() {
     else
         out << '\t' << "st_open(...) successful!" << endl;
 
+    // books and letters start with markup, everything else is plain text
+    const char * bookPrefixes[] = { "<font", "<div", "<p", "<br", "[page" };
+    const size_t numBookPrefixes = sizeof(bookPrefixes) / sizeof(bookPrefixes[0]);
+
+    st_pattern bookPatterns[numBookPrefixes];
+    for (size_t i=0; i < numBookPrefixes; i++) {
+        bookPatterns[i].text = bookPrefixes[i];
+        bookPatterns[i].type = LIBSTRINGS_PATTERN_PREFIX;
+    }
+
+    out << "TESTING st_filter_ids(...)" << endl;
+    const uint32_t * bookIdArr;
+    size_t bookIdArrSize;
+    set<uint32_t> bookIds;
+    ret = st_filter_ids(sh_main, bookPatterns, numBookPrefixes, &bookIdArr, &bookIdArrSize);
+    if (ret != LIBSTRINGS_OK)
+        out << '\t' << "st_filter_ids(...) failed! Return code: " << ret << endl;
+    else {
+        out << '\t' << "st_filter_ids(...) successful! Number of books: " << bookIdArrSize << endl;
+        bookIds.insert(bookIdArr, bookIdArr + bookIdArrSize);
+    }
+
     out << "\n\n\n\n\nTESTING display all books:\n" << endl;
     ret = st_get_strings(sh_main, &dataArr, &dataArrSize);
     if (ret != LIBSTRINGS_OK)
@@ -78,50 +102,31 @@ int main() {
         out << '\t' << "ID" << '\t' << "Book Content" << endl;
         // check if this item is a book
         for (size_t i=0; i < dataArrSize; i++) {
-            if (string(dataArr[i].data).substr(0, 5) == "<font"
-                || string(dataArr[i].data).substr(0, 4) == "<div"
-                || string(dataArr[i].data).substr(0, 2) == "<p"
-                || string(dataArr[i].data).substr(0, 3) == "<br"
-                || string(dataArr[i].data).substr(0, 5) == "[page") {
+            if (bookIds.count(dataArr[i].id) > 0)
                 out << "\nBOOKS & LETTERS ================================================================================================================================\n";
-                out << dataArr[i].id << ":\n";
-                out << dataArr[i].data << endl;
-                out << "\n\n";
-            }
-            else{
+            else
                 out << "\nOther item ================================================================================================================================\n";
-                out << dataArr[i].id << ":\n";
-                out << dataArr[i].data << endl;
-                out << "\n\n";
-
-                // if ont a book, use native English to replace it
-                char * str;
-                ret = st_get_string(sh_english, dataArr[i].id, &str);
-                if (ret != LIBSTRINGS_OK)
-                    cout << '\t' << "st_get_string(...) failed! Return code: " << ret << " ID: " << dataArr[i].id << endl;
-                else {
-//                    cout << '\t' << "st_get_string(...) successful!"  << endl;
-//                    cout << '\t' << "String fetched: ENG: " << str << ", CN: " << dataArr[i].data << endl;
-                }
-
-                ret = st_replace_string(sh_main, dataArr[i].id, str);
-                if (ret != LIBSTRINGS_OK)
-                    cout << '\t' << "st_replace_string(...) failed! Return code: " << ret << endl;
-                else {
-//                    cout << '\t' << "st_replace_string(...) successful!"  << endl;
-                }
-
-//                out << "TESTING st_remove_string(...)" << endl;
-//                ret = st_remove_string(sh_main, dataArr[i].id);
-//                if (ret != LIBSTRINGS_OK)
-//                    cout << '\t' << "st_remove_string(...) failed! Return code: " << ret << endl;
-//                else {
-//                    cout << '\t' << "st_remove_string(...) successful!"  << endl;
-//                }
-            }
+            out << dataArr[i].id << ":\n";
+            out << dataArr[i].data << endl;
+            out << "\n\n";
         }
     }
 
+    // if not a book, use native English to replace it
+    st_overlay_selector selector;
+    memset(&selector, 0, sizeof(selector));
+    selector.type = LIBSTRINGS_SELECT_PREFIXES;
+    selector.prefixes = bookPrefixes;
+    selector.numPrefixes = numBookPrefixes;
+    selector.invert = true;
+
+    out << "TESTING st_overlay(...)" << endl;
+    ret = st_overlay(sh_main, sh_english, &selector, 0);
+    if (ret != LIBSTRINGS_OK)
+        out << '\t' << "st_overlay(...) failed! Return code: " << ret << endl;
+    else
+        out << '\t' << "st_overlay(...) successful!" << endl;
+
     // save to new strings file
     out << "TESTING st_save(...)" << endl;
     ret = st_save(sh_main, newPath.c_str(), "UTF-8");
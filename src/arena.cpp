@@ -0,0 +1,170 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "arena.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+namespace libstrings {
+
+    static const size_t chunkSize = 64 * 1024;
+
+    string_arena::string_arena() : current(NULL), currentUsed(0), currentSize(0), size(0) {}
+
+    string_arena::~string_arena() {
+        Clear();
+    }
+
+    const char * string_arena::Append(const char * str, const size_t length) {
+        const size_t needed = length + 1;
+
+        if (currentSize - currentUsed < needed) {
+            chunks.reserve(chunks.size() + 1);
+
+            //Big strings get a chunk to themselves, so they don't waste the rest of the current chunk.
+            if (needed > chunkSize / 4) {
+                char * chunk = new char[needed];
+                chunks.push_back(chunk);
+                size += needed;
+                memcpy(chunk, str, length);
+                chunk[length] = '\0';
+                return chunk;
+            }
+
+            current = new char[chunkSize];
+            chunks.push_back(current);
+            currentUsed = 0;
+            currentSize = chunkSize;
+            size += chunkSize;
+        }
+
+        char * dst = current + currentUsed;
+        memcpy(dst, str, length);
+        dst[length] = '\0';
+        currentUsed += needed;
+
+        return dst;
+    }
+
+    void string_arena::Adopt(char * buffer, const size_t bufferSize) {
+        try {
+            chunks.push_back(buffer);
+        } catch (...) {
+            delete [] buffer;
+            throw;
+        }
+        size += bufferSize;
+    }
+
+    void string_arena::Merge(string_arena& other) {
+        //Keep appending to this arena's current chunk.
+        chunks.insert(chunks.end(), other.chunks.begin(), other.chunks.end());
+        size += other.size;
+
+        other.chunks.clear();
+        other.current = NULL;
+        other.currentUsed = 0;
+        other.currentSize = 0;
+        other.size = 0;
+    }
+
+    void string_arena::Clear() {
+        for (size_t i=0; i < chunks.size(); i++)
+            delete [] chunks[i];
+        chunks.clear();
+        current = NULL;
+        currentUsed = 0;
+        currentSize = 0;
+        size = 0;
+    }
+
+    void string_arena::Swap(string_arena& other) {
+        chunks.swap(other.chunks);
+        std::swap(current, other.current);
+        std::swap(currentUsed, other.currentUsed);
+        std::swap(currentSize, other.currentSize);
+        std::swap(size, other.size);
+    }
+
+    size_t string_arena::Size() const {
+        return size;
+    }
+
+    //Blocks are rounded up to this, so that every block is suitably aligned for a node.
+    static const size_t nodeAlign = sizeof(void*) > 8 ? sizeof(void*) : 8;
+
+    node_pool::node_pool() {}
+
+    node_pool::~node_pool() {
+        for (size_t i=0; i < chunks.size(); i++)
+            delete [] chunks[i];
+    }
+
+    node_pool::size_class& node_pool::Class(const size_t size) {
+        const size_t blockSize = (max(size, sizeof(void*)) + nodeAlign - 1) / nodeAlign * nodeAlign;
+        for (size_t i=0; i < classes.size(); i++) {
+            if (classes[i].size == blockSize)
+                return classes[i];
+        }
+        size_class c;
+        c.size = blockSize;
+        c.freeList = NULL;
+        c.current = NULL;
+        c.remaining = 0;
+        classes.push_back(c);
+        return classes.back();
+    }
+
+    void * node_pool::Allocate(const size_t size) {
+        size_class& c = Class(size);
+
+        if (c.freeList != NULL) {
+            void * block = c.freeList;
+            c.freeList = *static_cast<void**>(block);
+            return block;
+        }
+
+        if (c.remaining == 0) {
+            chunks.reserve(chunks.size() + 1);
+            c.current = new char[chunkSize];
+            chunks.push_back(c.current);
+            c.remaining = chunkSize / c.size;
+        }
+
+        void * block = c.current;
+        c.current += c.size;
+        c.remaining--;
+        return block;
+    }
+
+    void node_pool::Deallocate(void * block, const size_t size) {
+        if (block == NULL)
+            return;
+        size_class& c = Class(size);
+        *static_cast<void**>(block) = c.freeList;
+        c.freeList = block;
+    }
+}
@@ -0,0 +1,166 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_ARENA_H__
+#define __LIBSTRINGS_ARENA_H__
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+
+namespace libstrings {
+
+    /* Append-only storage for null-terminated strings. Strings are packed
+       into large chunks that never move, so pointers to them stay valid
+       until the arena is cleared or destroyed, and freeing the arena is one
+       deallocation per chunk. Nothing is freed individually: replaced
+       strings stay until everything live is copied into a new arena. */
+    class string_arena {
+    public:
+        string_arena();
+        ~string_arena();
+
+        //Copies the given string and a null terminator into the arena.
+        const char * Append(const char * str, const size_t length);
+
+        //Takes ownership of a buffer allocated with new[].
+        void Adopt(char * buffer, const size_t size);
+
+        //Takes ownership of all the memory held by another arena, leaving it empty.
+        void Merge(string_arena& other);
+
+        void Clear();
+        void Swap(string_arena& other);
+
+        size_t Size() const;  //Total bytes held.
+    private:
+        std::vector<char*> chunks;
+        char * current;
+        size_t currentUsed;
+        size_t currentSize;
+        size_t size;
+
+        //Not copyable.
+        string_arena(const string_arena&);
+        string_arena& operator = (const string_arena&);
+    };
+
+    /* Fixed-size blocks carved out of large chunks, for containers that
+       allocate one node at a time. Freed blocks are kept on a list per size
+       and reused, and the chunks are only freed with the pool, so a map of
+       n entries costs a handful of allocations instead of n. Not
+       thread-safe: callers must serialise access. */
+    class node_pool {
+    public:
+        node_pool();
+        ~node_pool();
+
+        void * Allocate(const size_t size);
+        void Deallocate(void * block, const size_t size);
+    private:
+        struct size_class {
+            size_t size;
+            void * freeList;
+            char * current;  //Next unused block in the newest chunk for this size.
+            size_t remaining;  //Unused blocks left at current.
+        };
+
+        size_class& Class(const size_t size);
+
+        std::vector<size_class> classes;
+        std::vector<char*> chunks;
+
+        //Not copyable.
+        node_pool(const node_pool&);
+        node_pool& operator = (const node_pool&);
+    };
+
+    /* Allocates single objects from a node_pool and arrays from the heap.
+       Copies and rebinds share the pool, which lives until the last of them
+       is destroyed, so a container and its rebound node allocators all use
+       one pool. Allocators are only equal if they share a pool, and swapping
+       containers swaps their pools along with their nodes. */
+    template<class T>
+    class pool_allocator {
+    public:
+        typedef T value_type;
+        typedef T * pointer;
+        typedef const T * const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        typedef boost::true_type propagate_on_container_copy_assignment;
+        typedef boost::true_type propagate_on_container_move_assignment;
+        typedef boost::true_type propagate_on_container_swap;
+
+        template<class U>
+        struct rebind {
+            typedef pool_allocator<U> other;
+        };
+
+        pool_allocator() : pool(new node_pool) {}
+        pool_allocator(const pool_allocator& other) : pool(other.pool) {}
+        template<class U>
+        pool_allocator(const pool_allocator<U>& other) : pool(other.pool) {}
+
+        pointer allocate(const size_type n, const void * = 0) {
+            if (n == 1)
+                return static_cast<pointer>(pool->Allocate(sizeof(T)));
+            else if (n > max_size())
+                throw std::bad_alloc();
+            return static_cast<pointer>(::operator new(n * sizeof(T)));
+        }
+
+        void deallocate(pointer p, const size_type n) {
+            if (n == 1)
+                pool->Deallocate(p, sizeof(T));
+            else
+                ::operator delete(p);
+        }
+
+        void construct(pointer p, const T& value) { new (p) T(value); }
+        void destroy(pointer p) { p->~T(); }
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+        size_type max_size() const { return size_t(-1) / sizeof(T); }
+
+        boost::shared_ptr<node_pool> pool;
+    };
+
+    template<class T, class U>
+    bool operator == (const pool_allocator<T>& a, const pool_allocator<U>& b) {
+        return a.pool == b.pool;
+    }
+
+    template<class T, class U>
+    bool operator != (const pool_allocator<T>& a, const pool_allocator<U>& b) {
+        return a.pool != b.pool;
+    }
+}
+
+#endif
@@ -0,0 +1,797 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* Generates synthetic strings files and times the library's functions on
+   them, printing the results as JSON so that they can be compared between
+   builds. Run with --help for the options. */
+
+#include "libstrings.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+using namespace std;
+
+namespace fs = boost::filesystem;
+
+/*------------------------------
+   Allocation Counting
+------------------------------*/
+
+/* Every allocation made through operator new, by the library or the
+   benchmark, is counted. The timed sections don't allocate anything
+   themselves, so the counts are the library's. The library may allocate
+   on its own threads, so the counts are atomic. */
+static boost::atomic<size_t> allocCount(0);
+static boost::atomic<size_t> allocBytes(0);
+
+void * operator new(size_t size) {
+    allocCount.fetch_add(1, boost::memory_order_relaxed);
+    allocBytes.fetch_add(size, boost::memory_order_relaxed);
+    void * p = malloc(size == 0 ? 1 : size);
+    if (p == NULL)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void * p) throw() {
+    free(p);
+}
+
+void operator delete(void * p, size_t) throw() {
+    free(p);
+}
+
+/*------------------------------
+   Settings
+------------------------------*/
+
+struct bench_settings {
+    bench_settings() :
+        entries(100000),
+        minLength(1),
+        maxLength(200),
+        skewedLengths(true),
+        duplicates(0.1),
+        unreferenced(0.01),
+        nonASCII(0.02),
+        encoding("UTF-8"),
+        iterations(5),
+        lookups(100000),
+        mutations(10000),
+        flags(LIBSTRINGS_OPEN_UNREF_STRINGS),
+        seed(1),
+        keep(false) {
+        formats.push_back("STRINGS");
+        formats.push_back("DLSTRINGS");
+        formats.push_back("ILSTRINGS");
+    }
+
+    size_t entries;
+    size_t minLength;
+    size_t maxLength;
+    bool skewedLengths;      //Most strings short, a few long, as in real files. Otherwise uniform.
+    double duplicates;       //Fraction of IDs that share an earlier ID's string.
+    double unreferenced;     //Number of unreferenced strings, as a fraction of the number of IDs.
+    double nonASCII;         //Fraction of characters that are not ASCII.
+    string encoding;         //Encoding the files are written in.
+    vector<string> formats;
+    size_t iterations;
+    size_t lookups;
+    size_t mutations;
+    unsigned int flags;      //Passed to st_open_ex().
+    unsigned int seed;
+    string dir;
+    string output;
+    bool keep;
+};
+
+static void PrintUsage() {
+    cout << "Usage: libstrings-bench [options]" << endl
+         << endl
+         << "Generates strings files and times libstrings on them, printing the results as JSON." << endl
+         << endl
+         << "  --entries N         Number of strings with IDs. Default: 100000." << endl
+         << "  --length MIN:MAX    String length range, in bytes. Default: 1:200." << endl
+         << "  --length-dist D     'skewed' (mostly short strings) or 'uniform'. Default: skewed." << endl
+         << "  --duplicates R      Fraction of IDs sharing another ID's string. Default: 0.1." << endl
+         << "  --unreferenced R    Unreferenced strings, as a fraction of IDs. Default: 0.01." << endl
+         << "  --non-ascii R       Fraction of non-ASCII characters. Default: 0.02." << endl
+         << "  --encoding E        UTF-8, Windows-1250, Windows-1251 or Windows-1252. Default: UTF-8." << endl
+         << "  --format F          STRINGS, DLSTRINGS, ILSTRINGS or all. Default: all." << endl
+         << "  --iterations N      Times each measurement is repeated. Default: 5." << endl
+         << "  --lookups N         Number of IDs looked up by st_get_string() and st_get_strings_by_ids(). Default: 100000." << endl
+         << "  --mutations N       Number of each kind of mutation timed. Default: 10000." << endl
+         << "  --flags N           Open flags passed to st_open_ex(). Default: LIBSTRINGS_OPEN_UNREF_STRINGS." << endl
+         << "  --seed N            Random seed. Default: 1." << endl
+         << "  --dir PATH          Directory to generate files in. Default: a temporary directory." << endl
+         << "  --output PATH       Write the JSON to a file instead of standard output." << endl
+         << "  --keep              Don't delete the generated files." << endl;
+}
+
+static bool ParseArgs(int argc, char * argv[], bench_settings& settings) {
+    for (int i=1; i < argc; i++) {
+        const string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            exit(0);
+        } else if (arg == "--keep") {
+            settings.keep = true;
+            continue;
+        }
+
+        if (i + 1 == argc) {
+            cerr << "Missing value for " << arg << endl;
+            return false;
+        }
+        const string value = argv[++i];
+
+        if (arg == "--entries")
+            settings.entries = strtoul(value.c_str(), NULL, 10);
+        else if (arg == "--length") {
+            //%zu isn't available to VC110's sscanf, so split the range by hand.
+            const size_t colon = value.find(':');
+            char * end = NULL;
+            if (colon != string::npos) {
+                settings.minLength = strtoul(value.c_str(), &end, 10);
+                if (end == value.c_str() + colon)
+                    settings.maxLength = strtoul(value.c_str() + colon + 1, &end, 10);
+            }
+            if (colon == string::npos || colon == 0 || end == NULL || *end != '\0' || end == value.c_str() + colon + 1 || settings.minLength > settings.maxLength) {
+                cerr << "Invalid length range: " << value << endl;
+                return false;
+            }
+        } else if (arg == "--length-dist") {
+            if (value != "skewed" && value != "uniform") {
+                cerr << "Invalid length distribution: " << value << endl;
+                return false;
+            }
+            settings.skewedLengths = (value == "skewed");
+        } else if (arg == "--duplicates")
+            settings.duplicates = atof(value.c_str());
+        else if (arg == "--unreferenced")
+            settings.unreferenced = atof(value.c_str());
+        else if (arg == "--non-ascii")
+            settings.nonASCII = atof(value.c_str());
+        else if (arg == "--encoding")
+            settings.encoding = value;
+        else if (arg == "--format") {
+            settings.formats.clear();
+            if (value == "all") {
+                settings.formats.push_back("STRINGS");
+                settings.formats.push_back("DLSTRINGS");
+                settings.formats.push_back("ILSTRINGS");
+            } else if (value == "STRINGS" || value == "DLSTRINGS" || value == "ILSTRINGS")
+                settings.formats.push_back(value);
+            else {
+                cerr << "Invalid format: " << value << endl;
+                return false;
+            }
+        } else if (arg == "--iterations")
+            settings.iterations = max<size_t>(1, strtoul(value.c_str(), NULL, 10));
+        else if (arg == "--lookups")
+            settings.lookups = strtoul(value.c_str(), NULL, 10);
+        else if (arg == "--mutations")
+            settings.mutations = strtoul(value.c_str(), NULL, 10);
+        else if (arg == "--flags")
+            settings.flags = strtoul(value.c_str(), NULL, 0);
+        else if (arg == "--seed")
+            settings.seed = strtoul(value.c_str(), NULL, 10);
+        else if (arg == "--dir")
+            settings.dir = value;
+        else if (arg == "--output")
+            settings.output = value;
+        else {
+            cerr << "Unknown option: " << arg << endl;
+            return false;
+        }
+    }
+
+    if (settings.entries == 0) {
+        cerr << "At least one entry is needed." << endl;
+        return false;
+    }
+
+    if (settings.encoding != "UTF-8" && settings.encoding != "Windows-1250" && settings.encoding != "Windows-1251" && settings.encoding != "Windows-1252") {
+        cerr << "Invalid encoding: " << settings.encoding << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*------------------------------
+   File Generation
+------------------------------*/
+
+struct generated_file {
+    string path;
+    uint64_t size;
+    vector<uint32_t> ids;
+    size_t uniqueStrings;
+    size_t unrefStrings;
+};
+
+static const char asciiChars[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789 .,'<>!?";
+static const char * const utf8Chars[] = { "\xC3\xA9", "\xC3\xB6", "\xD0\xB6", "\xE2\x82\xAC", "\xE4\xB8\xAD" };
+
+class string_generator {
+public:
+    string_generator(const bench_settings& settings, boost::random::mt19937& rng) :
+        settings(settings),
+        rng(rng),
+        unit(0.0, 1.0),
+        ascii(0, sizeof(asciiChars) - 2),
+        single(0xC0, 0xFF) {}
+
+    //Generates a string in the file's encoding.
+    string operator () () {
+        double u = unit(rng);
+        if (settings.skewedLengths)
+            u = u * u * u;
+        const size_t length = settings.minLength + size_t(u * (settings.maxLength - settings.minLength) + 0.5);
+
+        string str;
+        str.reserve(length + 4);
+        while (str.length() < length) {
+            if (unit(rng) >= settings.nonASCII)
+                str += asciiChars[ascii(rng)];
+            else if (settings.encoding != "UTF-8")
+                str += char(single(rng));  //Letters in all the Windows code pages, and never valid UTF-8.
+            else
+                str += utf8Chars[rng() % (sizeof(utf8Chars) / sizeof(utf8Chars[0]))];
+        }
+        return str;
+    }
+private:
+    const bench_settings& settings;
+    boost::random::mt19937& rng;
+    boost::random::uniform_real_distribution<double> unit;
+    boost::random::uniform_int_distribution<size_t> ascii;
+    boost::random::uniform_int_distribution<int> single;
+};
+
+static void AppendUInt32(string& buffer, const uint32_t value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(uint32_t));
+}
+
+static void AppendString(string& data, const string& str, const bool isDotStrings) {
+    if (!isDotStrings)
+        AppendUInt32(data, str.length() + 1);
+    data += str;
+    data += '\0';
+}
+
+/* Writes the file directly rather than through the library, so that it can
+   contain unreferenced strings and strings in any encoding. */
+static generated_file GenerateFile(const bench_settings& settings, const string& format, const fs::path& dir) {
+    boost::random::mt19937 rng(settings.seed);
+    boost::random::uniform_real_distribution<double> unit(0.0, 1.0);
+    boost::random::uniform_int_distribution<uint32_t> gap(1, 8);
+    string_generator generate(settings, rng);
+    const bool isDotStrings = (format == "STRINGS");
+
+    generated_file file;
+    file.path = (dir / ("bench." + format)).string();
+    file.uniqueStrings = 0;
+    file.unrefStrings = 0;
+
+    string directory;
+    string data;
+    vector<uint32_t> offsets;
+    uint32_t id = 0;
+    double unrefDue = 0;
+    for (size_t i=0; i < settings.entries; i++) {
+        id += gap(rng);
+        file.ids.push_back(id);
+
+        uint32_t offset;
+        if (!offsets.empty() && unit(rng) < settings.duplicates)
+            offset = offsets[rng() % offsets.size()];
+        else {
+            offset = data.length();
+            offsets.push_back(offset);
+            AppendString(data, generate(), isDotStrings);
+            file.uniqueStrings++;
+        }
+        AppendUInt32(directory, id);
+        AppendUInt32(directory, offset);
+
+        //Spread the unreferenced strings evenly through the data.
+        unrefDue += settings.unreferenced;
+        while (unrefDue >= 1) {
+            AppendString(data, generate(), isDotStrings);
+            file.unrefStrings++;
+            unrefDue -= 1;
+        }
+    }
+
+    std::ofstream out(file.path.c_str(), ios::binary | ios::trunc);
+    string header;
+    AppendUInt32(header, settings.entries);
+    AppendUInt32(header, data.length());
+    out << header << directory << data;
+    out.close();
+    if (!out.good())
+        throw runtime_error("Could not write to \"" + file.path + "\".");
+
+    file.size = fs::file_size(file.path);
+    return file;
+}
+
+/*------------------------------
+   Measurement
+------------------------------*/
+
+struct phase_result {
+    string name;
+    size_t items;                  //Number of strings or calls the phase handles.
+    uint64_t bytes;                //Number of file bytes the phase handles, or 0.
+    vector<double> seconds;
+    size_t allocations;
+    size_t allocatedBytes;
+};
+
+class phase_timer {
+public:
+    phase_timer(phase_result& result) : result(result) {
+        allocCount.store(0);
+        allocBytes.store(0);
+        start = boost::chrono::steady_clock::now();
+    }
+
+    ~phase_timer() {
+        const boost::chrono::steady_clock::time_point end = boost::chrono::steady_clock::now();
+        result.allocations = allocCount.load();
+        result.allocatedBytes = allocBytes.load();
+        result.seconds.push_back(boost::chrono::duration<double>(end - start).count());
+    }
+private:
+    phase_result& result;
+    boost::chrono::steady_clock::time_point start;
+};
+
+static void Check(const unsigned int ret, const char * function) {
+    if (ret == LIBSTRINGS_OK)
+        return;
+
+    const char * message = NULL;
+    st_get_error_message(&message);
+    throw runtime_error(string(function) + " failed with return code " + boost::lexical_cast<string>(ret) + ": " + (message == NULL ? "" : message));
+}
+
+//Touches each string passed by st_iterate(), so that the strings are actually read.
+static int CountBytes(void * userdata, uint32_t, const char * data, size_t length) {
+    *static_cast<uint64_t*>(userdata) += length + (length > 0 ? data[length - 1] : 0);
+    return 0;
+}
+
+static vector<phase_result> RunBenchmark(const bench_settings& settings, const generated_file& file, const string& format, const fs::path& dir) {
+    enum { OPEN, GET_STRINGS, GET_STRINGS_VIEW, GET_STRING, GET_STRINGS_BY_IDS, FILTER_IDS, BUILD_SEARCH_INDEX, SEARCH, BUILD_ID_INDEX, GET_STRING_RANGE, REPLACE, ADD, REMOVE, APPLY_EDITS, SAVE, SAVE_INCREMENTAL, SAVE_SNAPSHOT, OPEN_SNAPSHOT, DIFF, WRITER, CLOSE, ITERATE, PHASE_COUNT };
+    const char * names[PHASE_COUNT] = { "st_open", "st_get_strings", "st_get_strings_view", "st_get_string", "st_get_strings_by_ids", "st_filter_ids", "st_build_search_index", "st_search", "st_build_id_index", "st_get_string_range", "st_replace_string", "st_add_string", "st_remove_string", "st_apply_edits", "st_save", "st_save_ex_incremental", "st_save_snapshot", "st_open_snapshot", "st_diff", "st_writer", "st_close", "st_iterate" };
+
+    vector<phase_result> results(PHASE_COUNT);
+    for (size_t i=0; i < PHASE_COUNT; i++) {
+        results[i].name = names[i];
+        results[i].bytes = 0;
+        results[i].allocations = 0;
+        results[i].allocatedBytes = 0;
+    }
+
+    //Pick the strings and IDs used up front, so their generation isn't timed.
+    boost::random::mt19937 rng(settings.seed + 1);
+    string_generator generate(settings, rng);
+    vector<uint32_t> lookupIds(settings.lookups);
+    for (size_t i=0; i < lookupIds.size(); i++)
+        lookupIds[i] = file.ids[rng() % file.ids.size()];
+
+    const size_t mutations = min(settings.mutations, file.ids.size());
+    vector<uint32_t> replaceIds(mutations);
+    vector<uint32_t> addIds(mutations);
+    vector<string> newStrings(mutations);
+    for (size_t i=0; i < mutations; i++) {
+        replaceIds[i] = file.ids[rng() % file.ids.size()];
+        addIds[i] = file.ids.back() + 1 + i;
+        newStrings[i] = generate();
+    }
+
+    vector<uint32_t> rangeStarts(min<size_t>(1000, lookupIds.size()));
+    for (size_t i=0; i < rangeStarts.size(); i++)
+        rangeStarts[i] = lookupIds[i];
+
+    //Searches are for short runs of ASCII, which is valid UTF-8 in any file.
+    vector<string> queries(100);
+    for (size_t i=0; i < queries.size(); i++) {
+        for (size_t j=0; j < 4; j++)
+            queries[i] += asciiChars[rng() % (sizeof(asciiChars) - 1)];
+    }
+
+    //Strings given to the library are UTF-8.
+    const char * fallbackEncoding = settings.encoding == "UTF-8" ? "Windows-1252" : settings.encoding.c_str();
+    const string savePath = (dir / ("bench-saved." + format)).string();
+    const string snapshotPath = (dir / ("bench-saved." + format + ".snapshot")).string();
+
+    for (size_t iteration=0; iteration < settings.iterations; iteration++) {
+        st_strings_handle sh;
+        st_string_data * strings;
+        const st_string_view * views;
+        size_t numStrings;
+        char * str;
+
+        {
+            phase_timer timer(results[OPEN]);
+            Check(st_open_ex(&sh, file.path.c_str(), fallbackEncoding, settings.flags), "st_open_ex()");
+        }
+        {
+            phase_timer timer(results[GET_STRINGS]);
+            Check(st_get_strings(sh, &strings, &numStrings), "st_get_strings()");
+        }
+        results[GET_STRINGS].items = numStrings;
+        {
+            phase_timer timer(results[GET_STRINGS_VIEW]);
+            Check(st_get_strings_view(sh, &views, &numStrings), "st_get_strings_view()");
+        }
+        results[GET_STRINGS_VIEW].items = numStrings;
+        {
+            phase_timer timer(results[GET_STRING]);
+            for (size_t i=0; i < lookupIds.size(); i++)
+                Check(st_get_string(sh, lookupIds[i], &str), "st_get_string()");
+        }
+        results[GET_STRING].items = lookupIds.size();
+        {
+            const uint8_t * found;
+            phase_timer timer(results[GET_STRINGS_BY_IDS]);
+            Check(st_get_strings_by_ids(sh, lookupIds.empty() ? NULL : &lookupIds[0], lookupIds.size(), &views, &found), "st_get_strings_by_ids()");
+        }
+        results[GET_STRINGS_BY_IDS].items = lookupIds.size();
+        {
+            //The markup that book texts start with, plus a word found anywhere.
+            const st_pattern patterns[] = { { "<font", LIBSTRINGS_PATTERN_PREFIX }, { "<div", LIBSTRINGS_PATTERN_PREFIX }, { "<p", LIBSTRINGS_PATTERN_PREFIX }, { "<br", LIBSTRINGS_PATTERN_PREFIX }, { "[page", LIBSTRINGS_PATTERN_PREFIX }, { "the", LIBSTRINGS_PATTERN_CONTAINS } };
+            const uint32_t * ids;
+            size_t numIds;
+            phase_timer timer(results[FILTER_IDS]);
+            Check(st_filter_ids(sh, patterns, sizeof(patterns) / sizeof(patterns[0]), &ids, &numIds), "st_filter_ids()");
+        }
+        results[FILTER_IDS].items = numStrings;
+        {
+            phase_timer timer(results[BUILD_SEARCH_INDEX]);
+            Check(st_build_search_index(sh), "st_build_search_index()");
+        }
+        results[BUILD_SEARCH_INDEX].items = numStrings;
+        {
+            const uint32_t * ids;
+            size_t numIds;
+            phase_timer timer(results[SEARCH]);
+            for (size_t i=0; i < queries.size(); i++)
+                Check(st_search(sh, queries[i].c_str(), LIBSTRINGS_SEARCH_IGNORE_CASE, &ids, &numIds), "st_search()");
+        }
+        results[SEARCH].items = queries.size();
+        {
+            phase_timer timer(results[BUILD_ID_INDEX]);
+            Check(st_build_id_index(sh), "st_build_id_index()");
+        }
+        results[BUILD_ID_INDEX].items = numStrings;
+        {
+            //Ranges of about a hundred IDs, starting at the lookup IDs.
+            size_t numViews = 0;
+            phase_timer timer(results[GET_STRING_RANGE]);
+            for (size_t i=0; i < rangeStarts.size(); i++) {
+                size_t numRangeViews;
+                Check(st_get_string_range(sh, rangeStarts[i], rangeStarts[i] + 450, &views, &numRangeViews), "st_get_string_range()");
+                numViews += numRangeViews;
+            }
+            results[GET_STRING_RANGE].items = numViews;
+        }
+
+        //Only UTF-8 strings can be added, so use the generated strings when they are.
+        const bool utf8 = settings.encoding == "UTF-8";
+        {
+            phase_timer timer(results[REPLACE]);
+            for (size_t i=0; i < mutations; i++)
+                Check(st_replace_string(sh, replaceIds[i], utf8 ? newStrings[i].c_str() : "replacement"), "st_replace_string()");
+        }
+        results[REPLACE].items = mutations;
+        {
+            phase_timer timer(results[ADD]);
+            for (size_t i=0; i < mutations; i++)
+                Check(st_add_string(sh, addIds[i], utf8 ? newStrings[i].c_str() : "addition"), "st_add_string()");
+        }
+        results[ADD].items = mutations;
+        {
+            phase_timer timer(results[REMOVE]);
+            for (size_t i=0; i < mutations; i++)
+                Check(st_remove_string(sh, addIds[i]), "st_remove_string()");
+        }
+        results[REMOVE].items = mutations;
+        {
+            //The same changes as the three phases above, made in one call.
+            vector<st_string_edit> edits(3 * mutations);
+            for (size_t i=0; i < mutations; i++) {
+                edits[i].op = LIBSTRINGS_EDIT_REPLACE;
+                edits[i].id = replaceIds[i];
+                edits[i].data = utf8 ? newStrings[i].c_str() : "replacement";
+                edits[mutations + i].op = LIBSTRINGS_EDIT_ADD;
+                edits[mutations + i].id = addIds[i];
+                edits[mutations + i].data = utf8 ? newStrings[i].c_str() : "addition";
+                edits[2 * mutations + i].op = LIBSTRINGS_EDIT_REMOVE;
+                edits[2 * mutations + i].id = addIds[i];
+                edits[2 * mutations + i].data = NULL;
+            }
+
+            const uint8_t * statuses;
+            phase_timer timer(results[APPLY_EDITS]);
+            Check(st_apply_edits(sh, edits.empty() ? NULL : &edits[0], edits.size(), &statuses), "st_apply_edits()");
+        }
+        results[APPLY_EDITS].items = 3 * mutations;
+        {
+            phase_timer timer(results[SAVE]);
+            Check(st_save(sh, savePath.c_str(), settings.encoding.c_str()), "st_save()");
+        }
+        results[SAVE].items = file.ids.size();
+        results[SAVE].bytes = fs::file_size(savePath);
+        {
+            //A few more edits, as an editor saving after each change would make.
+            const size_t edits = min<size_t>(10, mutations);
+            for (size_t i=0; i < edits; i++)
+                Check(st_replace_string(sh, replaceIds[i], "edited"), "st_replace_string()");
+
+            phase_timer timer(results[SAVE_INCREMENTAL]);
+            Check(st_save_ex(sh, savePath.c_str(), settings.encoding.c_str(), LIBSTRINGS_SAVE_INCREMENTAL), "st_save_ex()");
+        }
+        results[SAVE_INCREMENTAL].items = min<size_t>(10, mutations);
+        {
+            //The handle now matches the saved file, so it can be snapshotted.
+            phase_timer timer(results[SAVE_SNAPSHOT]);
+            Check(st_save_snapshot(sh, snapshotPath.c_str()), "st_save_snapshot()");
+        }
+        results[SAVE_SNAPSHOT].items = file.ids.size();
+        results[SAVE_SNAPSHOT].bytes = fs::file_size(snapshotPath);
+        {
+            st_strings_handle snapshot;
+            phase_timer timer(results[OPEN_SNAPSHOT]);
+            Check(st_open_snapshot(&snapshot, snapshotPath.c_str(), savePath.c_str()), "st_open_snapshot()");
+            st_close(snapshot);
+        }
+        results[OPEN_SNAPSHOT].items = file.ids.size();
+        results[OPEN_SNAPSHOT].bytes = fs::file_size(snapshotPath);
+        {
+            //Find what the edits above changed, as comparing two versions of a file would.
+            st_strings_handle original;
+            Check(st_open_ex(&original, file.path.c_str(), fallbackEncoding, settings.flags), "st_open_ex()");
+            {
+                st_diff_result diff;
+                phase_timer timer(results[DIFF]);
+                Check(st_diff(original, sh, &diff), "st_diff()");
+            }
+            st_close(original);
+        }
+        results[DIFF].items = file.ids.size();
+        {
+            //Write the same strings again, streaming them out one at a time.
+            Check(st_get_strings(sh, &strings, &numStrings), "st_get_strings()");
+
+            st_writer_handle wh;
+            phase_timer timer(results[WRITER]);
+            Check(st_writer_open(&wh, savePath.c_str(), settings.encoding.c_str()), "st_writer_open()");
+            for (size_t i=0; i < numStrings; i++)
+                Check(st_writer_add(wh, strings[i].id, strings[i].data), "st_writer_add()");
+            Check(st_writer_finish(wh), "st_writer_finish()");
+            st_writer_close(wh);
+        }
+        results[WRITER].items = numStrings;
+        results[WRITER].bytes = fs::file_size(savePath);
+        {
+            phase_timer timer(results[CLOSE]);
+            st_close(sh);
+        }
+        results[CLOSE].items = 1;
+        {
+            uint64_t total = 0;
+            phase_timer timer(results[ITERATE]);
+            Check(st_iterate(file.path.c_str(), fallbackEncoding, CountBytes, &total), "st_iterate()");
+        }
+        results[ITERATE].items = file.ids.size();
+        results[ITERATE].bytes = file.size;
+    }
+    results[OPEN].items = file.ids.size();
+    results[OPEN].bytes = file.size;
+
+    if (!settings.keep) {
+        fs::remove(savePath);
+        fs::remove(snapshotPath);
+    }
+
+    return results;
+}
+
+/*------------------------------
+   Output
+------------------------------*/
+
+static string JSONString(const string& str) {
+    string out = "\"";
+    for (size_t i=0; i < str.length(); i++) {
+        if (str[i] == '"' || str[i] == '\\')
+            out += '\\';
+        out += str[i];
+    }
+    return out + '"';
+}
+
+//Gets what the library did between two calls to st_get_global_stats().
+static st_stats StatsBetween(const st_stats& before, const st_stats& after) {
+    st_stats diff;
+    diff.bytesRead = after.bytesRead - before.bytesRead;
+    diff.bytesWritten = after.bytesWritten - before.bytesWritten;
+    diff.stringsDecoded = after.stringsDecoded - before.stringsDecoded;
+    diff.stringsTranscoded = after.stringsTranscoded - before.stringsTranscoded;
+    diff.dedupHits = after.dedupHits - before.dedupHits;
+    diff.exportAllocations = after.exportAllocations - before.exportAllocations;
+    diff.readNanoseconds = after.readNanoseconds - before.readNanoseconds;
+    diff.parseNanoseconds = after.parseNanoseconds - before.parseNanoseconds;
+    diff.validateNanoseconds = after.validateNanoseconds - before.validateNanoseconds;
+    diff.transcodeNanoseconds = after.transcodeNanoseconds - before.transcodeNanoseconds;
+    diff.dedupNanoseconds = after.dedupNanoseconds - before.dedupNanoseconds;
+    diff.writeNanoseconds = after.writeNanoseconds - before.writeNanoseconds;
+    return diff;
+}
+
+static void WriteResults(ostream& out, const bench_settings& settings, const vector<generated_file>& files, const vector< vector<phase_result> >& results, const vector<st_stats>& stats) {
+    unsigned int major, minor, patch;
+    st_get_version(&major, &minor, &patch);
+
+    out.precision(9);
+    out << "{" << endl
+        << "  \"version\": \"" << major << '.' << minor << '.' << patch << "\"," << endl
+        << "  \"settings\": {" << endl
+        << "    \"entries\": " << settings.entries << "," << endl
+        << "    \"min_length\": " << settings.minLength << "," << endl
+        << "    \"max_length\": " << settings.maxLength << "," << endl
+        << "    \"length_dist\": " << JSONString(settings.skewedLengths ? "skewed" : "uniform") << "," << endl
+        << "    \"duplicates\": " << settings.duplicates << "," << endl
+        << "    \"unreferenced\": " << settings.unreferenced << "," << endl
+        << "    \"non_ascii\": " << settings.nonASCII << "," << endl
+        << "    \"encoding\": " << JSONString(settings.encoding) << "," << endl
+        << "    \"iterations\": " << settings.iterations << "," << endl
+        << "    \"lookups\": " << settings.lookups << "," << endl
+        << "    \"mutations\": " << settings.mutations << "," << endl
+        << "    \"flags\": " << settings.flags << "," << endl
+        << "    \"seed\": " << settings.seed << endl
+        << "  }," << endl
+        << "  \"results\": [" << endl;
+
+    for (size_t i=0; i < files.size(); i++) {
+        out << "    {" << endl
+            << "      \"format\": " << JSONString(settings.formats[i]) << "," << endl
+            << "      \"file_bytes\": " << files[i].size << "," << endl
+            << "      \"ids\": " << files[i].ids.size() << "," << endl
+            << "      \"unique_strings\": " << files[i].uniqueStrings << "," << endl
+            << "      \"unreferenced_strings\": " << files[i].unrefStrings << "," << endl
+            << "      \"phases\": {" << endl;
+
+        for (size_t j=0; j < results[i].size(); j++) {
+            const phase_result& phase = results[i][j];
+            vector<double> seconds = phase.seconds;
+            sort(seconds.begin(), seconds.end());
+            const double median = seconds[seconds.size() / 2];
+
+            out << "        " << JSONString(phase.name) << ": {"
+                << "\"median_seconds\": " << median
+                << ", \"min_seconds\": " << seconds.front()
+                << ", \"max_seconds\": " << seconds.back()
+                << ", \"items\": " << phase.items
+                << ", \"items_per_second\": " << (median > 0 ? phase.items / median : 0);
+            if (phase.bytes > 0)
+                out << ", \"bytes\": " << phase.bytes
+                    << ", \"bytes_per_second\": " << (median > 0 ? phase.bytes / median : 0);
+            out << ", \"allocations\": " << phase.allocations
+                << ", \"allocated_bytes\": " << phase.allocatedBytes
+                << "}" << (j + 1 < results[i].size() ? "," : "") << endl;
+        }
+
+        //All zero if the library was built without statistics.
+        out << "      }," << endl
+            << "      \"library_stats\": {"
+            << "\"bytes_read\": " << stats[i].bytesRead
+            << ", \"bytes_written\": " << stats[i].bytesWritten
+            << ", \"strings_decoded\": " << stats[i].stringsDecoded
+            << ", \"strings_transcoded\": " << stats[i].stringsTranscoded
+            << ", \"dedup_hits\": " << stats[i].dedupHits
+            << ", \"export_allocations\": " << stats[i].exportAllocations
+            << ", \"read_seconds\": " << stats[i].readNanoseconds / 1e9
+            << ", \"parse_seconds\": " << stats[i].parseNanoseconds / 1e9
+            << ", \"validate_seconds\": " << stats[i].validateNanoseconds / 1e9
+            << ", \"transcode_seconds\": " << stats[i].transcodeNanoseconds / 1e9
+            << ", \"dedup_seconds\": " << stats[i].dedupNanoseconds / 1e9
+            << ", \"write_seconds\": " << stats[i].writeNanoseconds / 1e9
+            << "}" << endl
+            << "    }" << (i + 1 < files.size() ? "," : "") << endl;
+    }
+
+    out << "  ]" << endl
+        << "}" << endl;
+}
+
+int main(int argc, char * argv[]) {
+    bench_settings settings;
+    if (!ParseArgs(argc, argv, settings)) {
+        PrintUsage();
+        return 1;
+    }
+
+    const bool tempDir = settings.dir.empty();
+    const fs::path dir = tempDir ? fs::temp_directory_path() / fs::unique_path("libstrings-bench-%%%%-%%%%") : fs::path(settings.dir);
+
+    vector<generated_file> files;
+    vector< vector<phase_result> > results;
+    vector<st_stats> stats;
+    try {
+        fs::create_directories(dir);
+        for (size_t i=0; i < settings.formats.size(); i++) {
+            files.push_back(GenerateFile(settings, settings.formats[i], dir));
+
+            st_stats before, after;
+            st_get_global_stats(&before);
+            results.push_back(RunBenchmark(settings, files.back(), settings.formats[i], dir));
+            st_get_global_stats(&after);
+            stats.push_back(StatsBetween(before, after));
+            if (!settings.keep)
+                fs::remove(files.back().path);
+        }
+        if (tempDir && !settings.keep)
+            fs::remove_all(dir);
+    } catch (exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    if (settings.output.empty())
+        WriteResults(cout, settings, files, results, stats);
+    else {
+        std::ofstream out(settings.output.c_str());
+        WriteResults(out, settings, files, results, stats);
+        if (!out.good()) {
+            cerr << "Could not write to \"" << settings.output << "\"." << endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "cache.h"
+
+using namespace std;
+
+namespace libstrings {
+
+    decode_cache::decode_cache(const size_t limit) : size(0), limit(limit) {}
+
+    const string * decode_cache::Get(const uint32_t id) {
+        boost::unordered_map<uint32_t, list_type::iterator>::iterator it = index.find(id);
+        if (it == index.end())
+            return NULL;
+
+        //Move to the front.
+        entries.splice(entries.begin(), entries, it->second);
+        return &it->second->second;
+    }
+
+    const string& decode_cache::Put(const uint32_t id, const string& str) {
+        Erase(id);
+
+        entries.push_front(pair<uint32_t, string>(id, str));
+        index.insert(pair<uint32_t, list_type::iterator>(id, entries.begin()));
+        size += str.length();
+
+        Trim();
+
+        return entries.front().second;
+    }
+
+    void decode_cache::Erase(const uint32_t id) {
+        boost::unordered_map<uint32_t, list_type::iterator>::iterator it = index.find(id);
+        if (it == index.end())
+            return;
+
+        size -= it->second->second.length();
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    void decode_cache::Clear() {
+        entries.clear();
+        index.clear();
+        size = 0;
+    }
+
+    void decode_cache::SetLimit(const size_t newLimit) {
+        limit = newLimit;
+        Trim();
+    }
+
+    size_t decode_cache::Size() const {
+        return size;
+    }
+
+    void decode_cache::Trim() {
+        while (size > limit && entries.size() > 1) {
+            size -= entries.back().second.length();
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_CACHE_H__
+#define __LIBSTRINGS_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <boost/unordered_map.hpp>
+
+namespace libstrings {
+
+    /* Holds decoded strings up to a total size limit, evicting the least
+       recently used first. The most recently added string is always kept, so
+       a reference returned by Put() stays valid until the next Put(). */
+    class decode_cache {
+    public:
+        decode_cache(const size_t limit);
+
+        const std::string * Get(const uint32_t id);  //Returns NULL on a miss.
+        const std::string& Put(const uint32_t id, const std::string& str);
+        void Erase(const uint32_t id);
+        void Clear();
+
+        void SetLimit(const size_t limit);
+        size_t Size() const;
+    private:
+        typedef std::list< std::pair<uint32_t, std::string> > list_type;
+
+        list_type entries;  //Most recently used first.
+        boost::unordered_map<uint32_t, list_type::iterator> index;
+        size_t size;
+        size_t limit;
+
+        void Trim();
+    };
+}
+
+#endif
@@ -0,0 +1,321 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "codepages.h"
+#include "simd.h"
+
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+
+namespace libstrings {
+
+    /*------------------------------
+       Code Page Tables
+    ------------------------------*/
+
+    /* Bytes below 0x80 are ASCII in all the supported code pages. The
+       toUnicode tables give the code point for each byte from 0x80 up, with
+       zero for bytes the code page doesn't define. The fromUnicode tables
+       are the same mappings sorted by code point, for encoding. */
+    struct code_page_mapping {
+        uint16_t codePoint;
+        uint8_t byte;
+    };
+
+    struct code_page {
+        const char * name;
+        const uint16_t * toUnicode;
+        const code_page_mapping * fromUnicode;
+        size_t fromUnicodeSize;
+    };
+
+    //Windows-1250.
+    static const uint16_t toUnicode1250[128] = {
+        0x20AC, 0x0000, 0x201A, 0x0000, 0x201E, 0x2026, 0x2020, 0x2021,
+        0x0000, 0x2030, 0x0160, 0x2039, 0x015A, 0x0164, 0x017D, 0x0179,
+        0x0000, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+        0x0000, 0x2122, 0x0161, 0x203A, 0x015B, 0x0165, 0x017E, 0x017A,
+        0x00A0, 0x02C7, 0x02D8, 0x0141, 0x00A4, 0x0104, 0x00A6, 0x00A7,
+        0x00A8, 0x00A9, 0x015E, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x017B,
+        0x00B0, 0x00B1, 0x02DB, 0x0142, 0x00B4, 0x00B5, 0x00B6, 0x00B7,
+        0x00B8, 0x0105, 0x015F, 0x00BB, 0x013D, 0x02DD, 0x013E, 0x017C,
+        0x0154, 0x00C1, 0x00C2, 0x0102, 0x00C4, 0x0139, 0x0106, 0x00C7,
+        0x010C, 0x00C9, 0x0118, 0x00CB, 0x011A, 0x00CD, 0x00CE, 0x010E,
+        0x0110, 0x0143, 0x0147, 0x00D3, 0x00D4, 0x0150, 0x00D6, 0x00D7,
+        0x0158, 0x016E, 0x00DA, 0x0170, 0x00DC, 0x00DD, 0x0162, 0x00DF,
+        0x0155, 0x00E1, 0x00E2, 0x0103, 0x00E4, 0x013A, 0x0107, 0x00E7,
+        0x010D, 0x00E9, 0x0119, 0x00EB, 0x011B, 0x00ED, 0x00EE, 0x010F,
+        0x0111, 0x0144, 0x0148, 0x00F3, 0x00F4, 0x0151, 0x00F6, 0x00F7,
+        0x0159, 0x016F, 0x00FA, 0x0171, 0x00FC, 0x00FD, 0x0163, 0x02D9
+    };
+
+    static const code_page_mapping fromUnicode1250[] = {
+        {0x00A0, 0xA0}, {0x00A4, 0xA4}, {0x00A6, 0xA6}, {0x00A7, 0xA7}, {0x00A8, 0xA8}, {0x00A9, 0xA9},
+        {0x00AB, 0xAB}, {0x00AC, 0xAC}, {0x00AD, 0xAD}, {0x00AE, 0xAE}, {0x00B0, 0xB0}, {0x00B1, 0xB1},
+        {0x00B4, 0xB4}, {0x00B5, 0xB5}, {0x00B6, 0xB6}, {0x00B7, 0xB7}, {0x00B8, 0xB8}, {0x00BB, 0xBB},
+        {0x00C1, 0xC1}, {0x00C2, 0xC2}, {0x00C4, 0xC4}, {0x00C7, 0xC7}, {0x00C9, 0xC9}, {0x00CB, 0xCB},
+        {0x00CD, 0xCD}, {0x00CE, 0xCE}, {0x00D3, 0xD3}, {0x00D4, 0xD4}, {0x00D6, 0xD6}, {0x00D7, 0xD7},
+        {0x00DA, 0xDA}, {0x00DC, 0xDC}, {0x00DD, 0xDD}, {0x00DF, 0xDF}, {0x00E1, 0xE1}, {0x00E2, 0xE2},
+        {0x00E4, 0xE4}, {0x00E7, 0xE7}, {0x00E9, 0xE9}, {0x00EB, 0xEB}, {0x00ED, 0xED}, {0x00EE, 0xEE},
+        {0x00F3, 0xF3}, {0x00F4, 0xF4}, {0x00F6, 0xF6}, {0x00F7, 0xF7}, {0x00FA, 0xFA}, {0x00FC, 0xFC},
+        {0x00FD, 0xFD}, {0x0102, 0xC3}, {0x0103, 0xE3}, {0x0104, 0xA5}, {0x0105, 0xB9}, {0x0106, 0xC6},
+        {0x0107, 0xE6}, {0x010C, 0xC8}, {0x010D, 0xE8}, {0x010E, 0xCF}, {0x010F, 0xEF}, {0x0110, 0xD0},
+        {0x0111, 0xF0}, {0x0118, 0xCA}, {0x0119, 0xEA}, {0x011A, 0xCC}, {0x011B, 0xEC}, {0x0139, 0xC5},
+        {0x013A, 0xE5}, {0x013D, 0xBC}, {0x013E, 0xBE}, {0x0141, 0xA3}, {0x0142, 0xB3}, {0x0143, 0xD1},
+        {0x0144, 0xF1}, {0x0147, 0xD2}, {0x0148, 0xF2}, {0x0150, 0xD5}, {0x0151, 0xF5}, {0x0154, 0xC0},
+        {0x0155, 0xE0}, {0x0158, 0xD8}, {0x0159, 0xF8}, {0x015A, 0x8C}, {0x015B, 0x9C}, {0x015E, 0xAA},
+        {0x015F, 0xBA}, {0x0160, 0x8A}, {0x0161, 0x9A}, {0x0162, 0xDE}, {0x0163, 0xFE}, {0x0164, 0x8D},
+        {0x0165, 0x9D}, {0x016E, 0xD9}, {0x016F, 0xF9}, {0x0170, 0xDB}, {0x0171, 0xFB}, {0x0179, 0x8F},
+        {0x017A, 0x9F}, {0x017B, 0xAF}, {0x017C, 0xBF}, {0x017D, 0x8E}, {0x017E, 0x9E}, {0x02C7, 0xA1},
+        {0x02D8, 0xA2}, {0x02D9, 0xFF}, {0x02DB, 0xB2}, {0x02DD, 0xBD}, {0x2013, 0x96}, {0x2014, 0x97},
+        {0x2018, 0x91}, {0x2019, 0x92}, {0x201A, 0x82}, {0x201C, 0x93}, {0x201D, 0x94}, {0x201E, 0x84},
+        {0x2020, 0x86}, {0x2021, 0x87}, {0x2022, 0x95}, {0x2026, 0x85}, {0x2030, 0x89}, {0x2039, 0x8B},
+        {0x203A, 0x9B}, {0x20AC, 0x80}, {0x2122, 0x99}
+    };
+
+    //Windows-1251.
+    static const uint16_t toUnicode1251[128] = {
+        0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021,
+        0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+        0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+        0x0000, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+        0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7,
+        0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+        0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7,
+        0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+        0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+        0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+        0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+        0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+        0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+        0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+        0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+        0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F
+    };
+
+    static const code_page_mapping fromUnicode1251[] = {
+        {0x00A0, 0xA0}, {0x00A4, 0xA4}, {0x00A6, 0xA6}, {0x00A7, 0xA7}, {0x00A9, 0xA9}, {0x00AB, 0xAB},
+        {0x00AC, 0xAC}, {0x00AD, 0xAD}, {0x00AE, 0xAE}, {0x00B0, 0xB0}, {0x00B1, 0xB1}, {0x00B5, 0xB5},
+        {0x00B6, 0xB6}, {0x00B7, 0xB7}, {0x00BB, 0xBB}, {0x0401, 0xA8}, {0x0402, 0x80}, {0x0403, 0x81},
+        {0x0404, 0xAA}, {0x0405, 0xBD}, {0x0406, 0xB2}, {0x0407, 0xAF}, {0x0408, 0xA3}, {0x0409, 0x8A},
+        {0x040A, 0x8C}, {0x040B, 0x8E}, {0x040C, 0x8D}, {0x040E, 0xA1}, {0x040F, 0x8F}, {0x0410, 0xC0},
+        {0x0411, 0xC1}, {0x0412, 0xC2}, {0x0413, 0xC3}, {0x0414, 0xC4}, {0x0415, 0xC5}, {0x0416, 0xC6},
+        {0x0417, 0xC7}, {0x0418, 0xC8}, {0x0419, 0xC9}, {0x041A, 0xCA}, {0x041B, 0xCB}, {0x041C, 0xCC},
+        {0x041D, 0xCD}, {0x041E, 0xCE}, {0x041F, 0xCF}, {0x0420, 0xD0}, {0x0421, 0xD1}, {0x0422, 0xD2},
+        {0x0423, 0xD3}, {0x0424, 0xD4}, {0x0425, 0xD5}, {0x0426, 0xD6}, {0x0427, 0xD7}, {0x0428, 0xD8},
+        {0x0429, 0xD9}, {0x042A, 0xDA}, {0x042B, 0xDB}, {0x042C, 0xDC}, {0x042D, 0xDD}, {0x042E, 0xDE},
+        {0x042F, 0xDF}, {0x0430, 0xE0}, {0x0431, 0xE1}, {0x0432, 0xE2}, {0x0433, 0xE3}, {0x0434, 0xE4},
+        {0x0435, 0xE5}, {0x0436, 0xE6}, {0x0437, 0xE7}, {0x0438, 0xE8}, {0x0439, 0xE9}, {0x043A, 0xEA},
+        {0x043B, 0xEB}, {0x043C, 0xEC}, {0x043D, 0xED}, {0x043E, 0xEE}, {0x043F, 0xEF}, {0x0440, 0xF0},
+        {0x0441, 0xF1}, {0x0442, 0xF2}, {0x0443, 0xF3}, {0x0444, 0xF4}, {0x0445, 0xF5}, {0x0446, 0xF6},
+        {0x0447, 0xF7}, {0x0448, 0xF8}, {0x0449, 0xF9}, {0x044A, 0xFA}, {0x044B, 0xFB}, {0x044C, 0xFC},
+        {0x044D, 0xFD}, {0x044E, 0xFE}, {0x044F, 0xFF}, {0x0451, 0xB8}, {0x0452, 0x90}, {0x0453, 0x83},
+        {0x0454, 0xBA}, {0x0455, 0xBE}, {0x0456, 0xB3}, {0x0457, 0xBF}, {0x0458, 0xBC}, {0x0459, 0x9A},
+        {0x045A, 0x9C}, {0x045B, 0x9E}, {0x045C, 0x9D}, {0x045E, 0xA2}, {0x045F, 0x9F}, {0x0490, 0xA5},
+        {0x0491, 0xB4}, {0x2013, 0x96}, {0x2014, 0x97}, {0x2018, 0x91}, {0x2019, 0x92}, {0x201A, 0x82},
+        {0x201C, 0x93}, {0x201D, 0x94}, {0x201E, 0x84}, {0x2020, 0x86}, {0x2021, 0x87}, {0x2022, 0x95},
+        {0x2026, 0x85}, {0x2030, 0x89}, {0x2039, 0x8B}, {0x203A, 0x9B}, {0x20AC, 0x88}, {0x2116, 0xB9},
+        {0x2122, 0x99}
+    };
+
+    //Windows-1252.
+    static const uint16_t toUnicode1252[128] = {
+        0x20AC, 0x0000, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+        0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x0000, 0x017D, 0x0000,
+        0x0000, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+        0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x0000, 0x017E, 0x0178,
+        0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7,
+        0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+        0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7,
+        0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,
+        0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7,
+        0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+        0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7,
+        0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+        0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7,
+        0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+        0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,
+        0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF
+    };
+
+    static const code_page_mapping fromUnicode1252[] = {
+        {0x00A0, 0xA0}, {0x00A1, 0xA1}, {0x00A2, 0xA2}, {0x00A3, 0xA3}, {0x00A4, 0xA4}, {0x00A5, 0xA5},
+        {0x00A6, 0xA6}, {0x00A7, 0xA7}, {0x00A8, 0xA8}, {0x00A9, 0xA9}, {0x00AA, 0xAA}, {0x00AB, 0xAB},
+        {0x00AC, 0xAC}, {0x00AD, 0xAD}, {0x00AE, 0xAE}, {0x00AF, 0xAF}, {0x00B0, 0xB0}, {0x00B1, 0xB1},
+        {0x00B2, 0xB2}, {0x00B3, 0xB3}, {0x00B4, 0xB4}, {0x00B5, 0xB5}, {0x00B6, 0xB6}, {0x00B7, 0xB7},
+        {0x00B8, 0xB8}, {0x00B9, 0xB9}, {0x00BA, 0xBA}, {0x00BB, 0xBB}, {0x00BC, 0xBC}, {0x00BD, 0xBD},
+        {0x00BE, 0xBE}, {0x00BF, 0xBF}, {0x00C0, 0xC0}, {0x00C1, 0xC1}, {0x00C2, 0xC2}, {0x00C3, 0xC3},
+        {0x00C4, 0xC4}, {0x00C5, 0xC5}, {0x00C6, 0xC6}, {0x00C7, 0xC7}, {0x00C8, 0xC8}, {0x00C9, 0xC9},
+        {0x00CA, 0xCA}, {0x00CB, 0xCB}, {0x00CC, 0xCC}, {0x00CD, 0xCD}, {0x00CE, 0xCE}, {0x00CF, 0xCF},
+        {0x00D0, 0xD0}, {0x00D1, 0xD1}, {0x00D2, 0xD2}, {0x00D3, 0xD3}, {0x00D4, 0xD4}, {0x00D5, 0xD5},
+        {0x00D6, 0xD6}, {0x00D7, 0xD7}, {0x00D8, 0xD8}, {0x00D9, 0xD9}, {0x00DA, 0xDA}, {0x00DB, 0xDB},
+        {0x00DC, 0xDC}, {0x00DD, 0xDD}, {0x00DE, 0xDE}, {0x00DF, 0xDF}, {0x00E0, 0xE0}, {0x00E1, 0xE1},
+        {0x00E2, 0xE2}, {0x00E3, 0xE3}, {0x00E4, 0xE4}, {0x00E5, 0xE5}, {0x00E6, 0xE6}, {0x00E7, 0xE7},
+        {0x00E8, 0xE8}, {0x00E9, 0xE9}, {0x00EA, 0xEA}, {0x00EB, 0xEB}, {0x00EC, 0xEC}, {0x00ED, 0xED},
+        {0x00EE, 0xEE}, {0x00EF, 0xEF}, {0x00F0, 0xF0}, {0x00F1, 0xF1}, {0x00F2, 0xF2}, {0x00F3, 0xF3},
+        {0x00F4, 0xF4}, {0x00F5, 0xF5}, {0x00F6, 0xF6}, {0x00F7, 0xF7}, {0x00F8, 0xF8}, {0x00F9, 0xF9},
+        {0x00FA, 0xFA}, {0x00FB, 0xFB}, {0x00FC, 0xFC}, {0x00FD, 0xFD}, {0x00FE, 0xFE}, {0x00FF, 0xFF},
+        {0x0152, 0x8C}, {0x0153, 0x9C}, {0x0160, 0x8A}, {0x0161, 0x9A}, {0x0178, 0x9F}, {0x017D, 0x8E},
+        {0x017E, 0x9E}, {0x0192, 0x83}, {0x02C6, 0x88}, {0x02DC, 0x98}, {0x2013, 0x96}, {0x2014, 0x97},
+        {0x2018, 0x91}, {0x2019, 0x92}, {0x201A, 0x82}, {0x201C, 0x93}, {0x201D, 0x94}, {0x201E, 0x84},
+        {0x2020, 0x86}, {0x2021, 0x87}, {0x2022, 0x95}, {0x2026, 0x85}, {0x2030, 0x89}, {0x2039, 0x8B},
+        {0x203A, 0x9B}, {0x20AC, 0x80}, {0x2122, 0x99}
+    };
+
+    static const code_page codePages[] = {
+        {"Windows-1250", toUnicode1250, fromUnicode1250, sizeof(fromUnicode1250) / sizeof(code_page_mapping)},
+        {"Windows-1251", toUnicode1251, fromUnicode1251, sizeof(fromUnicode1251) / sizeof(code_page_mapping)},
+        {"Windows-1252", toUnicode1252, fromUnicode1252, sizeof(fromUnicode1252) / sizeof(code_page_mapping)}
+    };
+
+
+    /*------------------------------
+       Conversion Functions
+    ------------------------------*/
+
+    const code_page * FindCodePage(const std::string& encoding) {
+        for (size_t i=0; i < sizeof(codePages) / sizeof(code_page); i++) {
+            if (boost::iequals(codePages[i].name, encoding))
+                return &codePages[i];
+        }
+        return NULL;
+    }
+
+    bool DecodeCodePage(const code_page& codePage, const char * str, const size_t length, std::string& out, size_t& errorPos) {
+        //Each byte becomes at most three bytes of UTF-8.
+        out.resize(length * 3);
+        char * const begin = length > 0 ? &out[0] : NULL;
+        char * dst = begin;
+
+        size_t i = 0;
+        while (i < length) {
+            //Copy runs of ASCII in bulk.
+            if (static_cast<uint8_t>(str[i]) < 0x80) {
+                const size_t run = CopyASCII(str + i, length - i, dst);
+                i += run;
+                dst += run;
+                continue;
+            }
+
+            const uint16_t codePoint = codePage.toUnicode[static_cast<uint8_t>(str[i]) - 0x80];
+            if (codePoint == 0) {
+                errorPos = i;
+                out.clear();
+                return false;
+            }
+
+            if (codePoint < 0x800) {
+                *dst++ = static_cast<char>(0xC0 | (codePoint >> 6));
+                *dst++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+            } else {
+                *dst++ = static_cast<char>(0xE0 | (codePoint >> 12));
+                *dst++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                *dst++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+            }
+            i++;
+        }
+
+        out.resize(dst - begin);
+        return true;
+    }
+
+    bool EncodeCodePage(const code_page& codePage, const char * str, const size_t length, std::string& out, size_t& errorPos) {
+        //Each code point becomes one byte, so the output is never longer.
+        out.resize(length);
+        char * const begin = length > 0 ? &out[0] : NULL;
+        char * dst = begin;
+        const code_page_mapping * const mapBegin = codePage.fromUnicode;
+        const code_page_mapping * const mapEnd = codePage.fromUnicode + codePage.fromUnicodeSize;
+
+        size_t i = 0;
+        while (i < length) {
+            //Copy runs of ASCII in bulk.
+            if (static_cast<uint8_t>(str[i]) < 0x80) {
+                const size_t run = CopyASCII(str + i, length - i, dst);
+                i += run;
+                dst += run;
+                continue;
+            }
+
+            //Decode the UTF-8 sequence. Anything outside the BMP can't be mapped anyway.
+            const uint8_t lead = static_cast<uint8_t>(str[i]);
+            size_t extra;
+            uint32_t codePoint;
+            if (lead >= 0xC2 && lead <= 0xDF) {
+                extra = 1;
+                codePoint = lead & 0x1F;
+            } else if (lead >= 0xE0 && lead <= 0xEF) {
+                extra = 2;
+                codePoint = lead & 0x0F;
+            } else {
+                errorPos = i;
+                out.clear();
+                return false;
+            }
+
+            if (i + extra >= length) {
+                errorPos = i;
+                out.clear();
+                return false;
+            }
+            for (size_t j = 1; j <= extra; j++) {
+                const uint8_t c = static_cast<uint8_t>(str[i + j]);
+                if ((c & 0xC0) != 0x80) {
+                    errorPos = i;
+                    out.clear();
+                    return false;
+                }
+                codePoint = (codePoint << 6) | (c & 0x3F);
+            }
+
+            if (extra == 2 && codePoint < 0x800) {
+                errorPos = i;
+                out.clear();
+                return false;
+            }
+
+            //Look the code point up. Surrogates fail here too.
+            const code_page_mapping * lo = mapBegin;
+            const code_page_mapping * hi = mapEnd;
+            while (lo < hi) {
+                const code_page_mapping * mid = lo + (hi - lo) / 2;
+                if (mid->codePoint < codePoint)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo == mapEnd || lo->codePoint != codePoint || codePoint < 0x80) {
+                errorPos = i;
+                out.clear();
+                return false;
+            }
+
+            *dst++ = static_cast<char>(lo->byte);
+            i += extra + 1;
+        }
+
+        out.resize(dst - begin);
+        return true;
+    }
+}
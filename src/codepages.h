@@ -0,0 +1,43 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_CODEPAGES_H__
+#define __LIBSTRINGS_CODEPAGES_H__
+
+#include <stdint.h>
+#include <string>
+
+/* Built-in converters between UTF-8 and the single-byte Windows code pages
+   that strings files use. They don't throw: a character that can't be
+   converted makes them return false, giving its byte position. */
+namespace libstrings {
+    struct code_page;
+
+    // Returns NULL if there is no built-in converter for the encoding.
+    const code_page * FindCodePage(const std::string& encoding);
+
+    bool DecodeCodePage(const code_page& codePage, const char * str, const size_t length, std::string& out, size_t& errorPos);
+    bool EncodeCodePage(const code_page& codePage, const char * str, const size_t length, std::string& out, size_t& errorPos);
+}
+
+#endif
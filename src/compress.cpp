@@ -0,0 +1,198 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "compress.h"
+#include <algorithm>
+#include <cstring>
+#include <boost/unordered_map.hpp>
+
+using namespace std;
+
+namespace {
+    //Training compresses about this many bytes, taken in pieces of up to pieceSize bytes.
+    const size_t sampleSize = 1 << 16;
+    const size_t pieceSize = 512;
+
+    //Each round picks symbols from those used by the last round's compression, and pairs of them.
+    const size_t trainingRounds = 5;
+
+    /* Single bytes are weighted as FSST weights them, so that common bytes
+       are picked as symbols rather than escaped, which costs two bytes. */
+    const size_t singleByteWeight = 8;
+
+    //A symbol's bytes, padded with nulls, and its length.
+    typedef pair<uint64_t, uint8_t> candidate;
+
+    candidate MakeCandidate(const char * str, const size_t length) {
+        candidate result(0, uint8_t(min<size_t>(length, sizeof(uint64_t))));
+        memcpy(&result.first, str, result.second);
+        return result;
+    }
+
+    //Highest gain first, then in byte order so that training is deterministic.
+    bool IsBetter(const pair<size_t, candidate>& a, const pair<size_t, candidate>& b) {
+        if (a.first != b.first)
+            return a.first > b.first;
+        return a.second < b.second;
+    }
+}
+
+namespace libstrings {
+
+    const size_t symbol_table::maxOverrun;
+    const size_t symbol_table::maxSymbols;
+    const uint8_t symbol_table::escape;
+
+    symbol_table::symbol_table() : numSymbols(0) {
+        Index();
+    }
+
+    /* Symbols are picked as FSST does: each round compresses the sample with
+       the current symbols, and counts how many bytes each symbol used, each
+       escaped byte, and each pair of them next to each other would cover.
+       The candidates that would cover the most become the next symbols. */
+    void symbol_table::Train(const vector< pair<const char *, size_t> >& strings) {
+        uint64_t total = 0;
+        for (size_t i=0; i < strings.size(); i++)
+            total += strings[i].second;
+
+        //Take a piece starting every step bytes through the strings, as if they were joined together.
+        const uint64_t step = max<uint64_t>(pieceSize, total / (sampleSize / pieceSize));
+        vector< pair<const char *, size_t> > sample;
+        uint64_t start = 0, next = 0;
+        for (size_t i=0; i < strings.size(); i++) {
+            for (; next < start + strings[i].second; next += step) {
+                const size_t offset = next - start;
+                sample.push_back(pair<const char *, size_t>(strings[i].first + offset, min(pieceSize, strings[i].second - offset)));
+            }
+            start += strings[i].second;
+        }
+
+        numSymbols = 0;
+        Index();
+        for (size_t round=0; round < trainingRounds; round++) {
+            boost::unordered_map<candidate, size_t> gains;
+            for (size_t i=0; i < sample.size(); i++) {
+                const char * str = sample[i].first;
+                const size_t length = sample[i].second;
+
+                size_t previous = 0, previousLength = 0;
+                for (size_t pos=0; pos < length;) {
+                    const int code = Match(str + pos, length - pos);
+                    const size_t symbolLength = code < 0 ? 1 : lengths[code];
+
+                    gains[MakeCandidate(str + pos, symbolLength)] += symbolLength == 1 ? singleByteWeight : symbolLength;
+                    if (previousLength > 0) {
+                        const candidate joined = MakeCandidate(str + previous, previousLength + symbolLength);
+                        gains[joined] += joined.second;
+                    }
+
+                    previous = pos;
+                    previousLength = symbolLength;
+                    pos += symbolLength;
+                }
+            }
+
+            vector< pair<size_t, candidate> > ranked;
+            ranked.reserve(gains.size());
+            for (boost::unordered_map<candidate, size_t>::const_iterator it=gains.begin(), endIt=gains.end(); it != endIt; ++it)
+                ranked.push_back(pair<size_t, candidate>(it->second, it->first));
+            sort(ranked.begin(), ranked.end(), IsBetter);
+
+            numSymbols = min(ranked.size(), maxSymbols);
+            for (size_t i=0; i < numSymbols; i++) {
+                symbols[i] = ranked[i].second.first;
+                lengths[i] = ranked[i].second.second;
+            }
+            Index();
+        }
+    }
+
+    void symbol_table::Index() {
+        for (size_t i=0; i < 256; i++)
+            byteCodes[i] = -1;
+
+        //Sort the longer symbols by their first two bytes, then longest first.
+        vector<uint32_t> order;
+        for (size_t i=0; i < numSymbols; i++) {
+            const uint8_t * bytes = reinterpret_cast<const uint8_t *>(&symbols[i]);
+            if (lengths[i] == 1)
+                byteCodes[bytes[0]] = int(i);
+            else
+                order.push_back((uint32_t(bytes[0] | (bytes[1] << 8)) << 12) | ((sizeof(uint64_t) - lengths[i]) << 8) | uint32_t(i));
+        }
+        sort(order.begin(), order.end());
+
+        prefixStarts.assign(65536 + 1, 0);
+        prefixCodes.resize(order.size());
+        for (size_t i=0; i < order.size(); i++) {
+            prefixStarts[(order[i] >> 12) + 1]++;
+            prefixCodes[i] = uint8_t(order[i]);
+        }
+        for (size_t i=1; i < prefixStarts.size(); i++)
+            prefixStarts[i] += prefixStarts[i - 1];
+    }
+
+    int symbol_table::Match(const char * str, const size_t length) const {
+        if (length >= 2) {
+            const size_t prefix = uint8_t(str[0]) | (uint8_t(str[1]) << 8);
+            for (size_t i=prefixStarts[prefix]; i < prefixStarts[prefix + 1]; i++) {
+                const uint8_t code = prefixCodes[i];
+                if (lengths[code] <= length && memcmp(str, &symbols[code], lengths[code]) == 0)
+                    return code;
+            }
+        }
+        return byteCodes[uint8_t(str[0])];
+    }
+
+    void symbol_table::Compress(const char * str, const size_t length, string& out) const {
+        for (size_t pos=0; pos < length;) {
+            const int code = Match(str + pos, length - pos);
+            if (code < 0) {
+                out += char(escape);
+                out += str[pos];
+                pos++;
+            } else {
+                out += char(code);
+                pos += lengths[code];
+            }
+        }
+    }
+
+    //Every symbol is copied as eight bytes, which is why out may be overrun.
+    size_t symbol_table::Decompress(const char * codes, const size_t size, char * out) const {
+        const uint8_t * pos = reinterpret_cast<const uint8_t *>(codes);
+        const uint8_t * end = pos + size;
+        char * outPos = out;
+        while (pos < end) {
+            const uint8_t code = *pos++;
+            if (code == escape)
+                *outPos++ = char(*pos++);
+            else {
+                memcpy(outPos, &symbols[code], sizeof(uint64_t));
+                outPos += lengths[code];
+            }
+        }
+        return outPos - out;
+    }
+}
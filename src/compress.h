@@ -0,0 +1,75 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_COMPRESS_H__
+#define __LIBSTRINGS_COMPRESS_H__
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace libstrings {
+
+    /* A table of up to 255 symbols of one to eight bytes, trained on a sample
+       of the strings to be compressed. A compressed string is a sequence of
+       one-byte codes, each standing for a symbol, except for the escape code,
+       which is followed by a byte that isn't part of any symbol. Strings are
+       compressed individually, so any one can be decompressed on its own,
+       which just copies eight bytes per code. */
+    class symbol_table {
+    public:
+        symbol_table();
+
+        //Picks the symbols that most shorten pieces taken evenly from across the given strings.
+        void Train(const std::vector< std::pair<const char *, size_t> >& strings);
+
+        //Appends the codes for the given string to out.
+        void Compress(const char * str, const size_t length, std::string& out) const;
+
+        //Returns the length of the string decompressed into out, which must have room for maxOverrun more bytes than that.
+        size_t Decompress(const char * codes, const size_t size, char * out) const;
+
+        static const size_t maxOverrun = 7;
+    private:
+        static const size_t maxSymbols = 255;
+        static const uint8_t escape = 255;
+
+        uint64_t symbols[maxSymbols];  //Padded with nulls.
+        uint8_t lengths[maxSymbols];
+        size_t numSymbols;
+
+        /* The codes of the symbols longer than one byte that start with each
+           two bytes are prefixCodes[prefixStarts[p]] up to
+           prefixCodes[prefixStarts[p + 1]], longest first. */
+        std::vector<uint16_t> prefixStarts;
+        std::vector<uint8_t> prefixCodes;
+        int byteCodes[256];  //The code of each one-byte symbol, or -1.
+
+        void Index();
+        int Match(const char * str, const size_t length) const;  //The code of the longest symbol str starts with, or -1.
+    };
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "cursor.h"
+#include "format.h"
+#include "error.h"
+#include "helpers.h"
+#include "simd.h"
+#include <cstring>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+using namespace libstrings;
+
+namespace fs = boost::filesystem;
+
+_strings_cursor_int::_strings_cursor_int(const string& path, const string& fallbackEncoding) :
+    path(path),
+    fallbackEncoding(fallbackEncoding),
+    isUTF8(boost::iequals("UTF-8", fallbackEncoding)) {
+
+    //Check extension.
+    const string ext = fs::path(path).extension().string();
+    if (boost::iequals(ext, ".strings"))
+        isDotStrings = true;
+    else if (boost::iequals(ext, ".ilstrings") || boost::iequals(ext, ".dlstrings"))
+        isDotStrings = false;
+    else
+        throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "File passed does not have a valid extension.");
+
+    //Unlike st_open(), there's nothing to do with a file that doesn't exist. Mapping an empty file also fails.
+    try {
+        if (!fs::exists(path) || fs::file_size(path) == 0)
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
+    } catch (fs::filesystem_error& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what());
+    }
+
+    try {
+        mapping.open(path);
+    } catch (ios_base::failure& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not map \"" + path + "\": " + e.what());
+    }
+
+    GlobalStats().Add(STAT_BYTES_READ, mapping.size());
+
+    startOfData = FindDataBlock(mapping.data(), mapping.size(), path);
+    pos = sizeof(uint32_t) * 2;
+}
+
+_strings_cursor_int::~_strings_cursor_int() {
+    counts.AddTo(GlobalStats());
+}
+
+bool _strings_cursor_int::Next(st_string_view& view) {
+    if (pos >= startOfData)
+        return false;
+
+    const char * fileContent = mapping.data();
+    const uint32_t id = *reinterpret_cast<const uint32_t*>(fileContent + pos);
+    const uint32_t offset = *reinterpret_cast<const uint32_t*>(fileContent + pos + sizeof(uint32_t));
+
+    const char * str = StringAt(fileContent, mapping.size(), startOfData, offset, isDotStrings);
+    if (str == NULL)
+        throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
+
+    //Strings that need transcoding are given out from the buffer, which stays null-terminated.
+    const size_t length = strlen(str);
+    view.id = id;
+    if (isUTF8)
+        counts.CountDecoded();
+
+    if (isUTF8 || counts.Validate(str, length)) {
+        view.data = str;
+        view.length = length;
+    } else {
+        const uint64_t start = Ticks();
+        transcoded = TranscodeToUTF8(str, length, fallbackEncoding);
+        view.data = transcoded.c_str();
+        view.length = transcoded.length();
+        counts.AddTranscodeTicks(Ticks() - start);
+    }
+
+    pos += 2 * sizeof(uint32_t);
+    return true;
+}
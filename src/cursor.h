@@ -0,0 +1,67 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_CURSOR_H__
+#define __LIBSTRINGS_CURSOR_H__
+
+#include "libstrings.h"
+#include "stats.h"
+#include <stdint.h>
+#include <string>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/thread/mutex.hpp>
+
+/* Walks a file's directory in file order without building a handle. The
+   file is mapped, and strings that are valid UTF-8 are given out from where
+   they are, so memory use doesn't grow with the file. Any other string is
+   transcoded into a buffer that the next string reuses. */
+struct _strings_cursor_int {
+public:
+    _strings_cursor_int(const std::string& path, const std::string& fallbackEncoding);
+    ~_strings_cursor_int();  //Adds what the cursor decoded to the library's stats.
+
+    //Cursor functions lock this, so that a cursor can be shared between threads.
+    boost::mutex mutex;
+    st_string_view view;  //Output by st_cursor_next().
+
+    //Gets the next directory entry, returning false once there are none left.
+    bool Next(st_string_view& view);
+private:
+    std::string path;
+    std::string fallbackEncoding;
+    bool isUTF8;
+    bool isDotStrings;
+
+    boost::iostreams::mapped_file_source mapping;
+    uint64_t startOfData;
+    uint64_t pos;  //Of the next directory entry.
+
+    std::string transcoded;
+    libstrings::decode_stats counts;
+
+    //Not copyable.
+    _strings_cursor_int(const _strings_cursor_int&);
+    _strings_cursor_int& operator = (const _strings_cursor_int&);
+};
+
+#endif
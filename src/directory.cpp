@@ -0,0 +1,119 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "directory.h"
+#include "format.h"
+#include "error.h"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+using namespace std;
+using namespace libstrings;
+
+namespace fs = boost::filesystem;
+
+_strings_directory_int::_strings_directory_int(const string& path, const string& language, const string& fallbackEncoding, const unsigned int flags) : next(0) {
+    //Find the strings files for the language. Their names end in "_<language>".
+    try {
+        for (fs::directory_iterator it(path), endIt; it != endIt; ++it) {
+            if (!fs::is_regular_file(it->status()))
+                continue;
+
+            const string ext = it->path().extension().string();
+            if (!boost::iequals(ext, ".strings") && !boost::iequals(ext, ".dlstrings") && !boost::iequals(ext, ".ilstrings"))
+                continue;
+
+            if (!language.empty() && !boost::iends_with(it->path().stem().string(), "_" + language))
+                continue;
+
+            paths.push_back(it->path().string());
+        }
+    } catch (fs::filesystem_error& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what());
+    }
+    sort(paths.begin(), paths.end());
+
+    st_directory_file file;
+    file.path = NULL;
+    file.handle = NULL;
+    file.status = LIBSTRINGS_OK;
+    file.message = NULL;
+    files.assign(paths.size(), file);
+    messages.resize(paths.size());
+
+    /* Open the files on as many threads as there are cores, each taking the
+       next unopened file until there are none left. The calling thread is
+       one of them, so nothing is lost if no threads can be started. */
+    const size_t numThreads = max<size_t>(1, min<size_t>(boost::thread::hardware_concurrency(), paths.size()));
+    boost::thread_group threads;
+    try {
+        for (size_t i=1; i < numThreads; i++)
+            threads.create_thread(boost::bind(&_strings_directory_int::OpenFiles, this, boost::cref(fallbackEncoding), flags));
+    } catch (boost::thread_resource_error&) {}
+
+    OpenFiles(fallbackEncoding, flags);
+    threads.join_all();
+
+    //The strings are all in place now.
+    for (size_t i=0; i < files.size(); i++) {
+        files[i].path = paths[i].c_str();
+        if (files[i].status != LIBSTRINGS_OK)
+            files[i].message = messages[i].c_str();
+    }
+}
+
+_strings_directory_int::~_strings_directory_int() {
+    for (size_t i=0; i < files.size(); i++)
+        delete files[i].handle;
+}
+
+void _strings_directory_int::OpenFiles(const string& fallbackEncoding, const unsigned int flags) {
+    while (true) {
+        size_t i;
+        {
+            boost::lock_guard<boost::mutex> lock(nextMutex);
+            if (next == paths.size())
+                return;
+            i = next;
+            next++;
+        }
+
+        //Errors are recorded for the file, as this may not be the calling thread.
+        try {
+            files[i].handle = new _strings_handle_int(paths[i], fallbackEncoding, flags);
+        } catch (error& e) {
+            files[i].status = e.code();
+            messages[i] = e.what();
+        } catch (bad_alloc& e) {
+            files[i].status = LIBSTRINGS_ERROR_NO_MEM;
+            messages[i] = e.what();
+        } catch (exception& e) {
+            files[i].status = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+            messages[i] = e.what();
+        }
+    }
+}
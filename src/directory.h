@@ -0,0 +1,55 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_DIRECTORY_H__
+#define __LIBSTRINGS_DIRECTORY_H__
+
+#include "libstrings.h"
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+/* The strings files found in a directory, which are opened concurrently.
+   Files that fail to open get a NULL handle and their error. */
+struct _strings_directory_int {
+public:
+    _strings_directory_int(const std::string& path, const std::string& language, const std::string& fallbackEncoding, const unsigned int flags);
+    ~_strings_directory_int();
+
+    std::vector<st_directory_file> files;  //Points into paths and messages.
+private:
+    std::vector<std::string> paths;
+    std::vector<std::string> messages;
+
+    //Used by the loading threads to take the next file to open.
+    boost::mutex nextMutex;
+    size_t next;
+
+    void OpenFiles(const std::string& fallbackEncoding, const unsigned int flags);
+
+    //Not copyable.
+    _strings_directory_int(const _strings_directory_int&);
+    _strings_directory_int& operator = (const _strings_directory_int&);
+};
+
+#endif
@@ -26,22 +26,141 @@
 #include "error.h"
 #include "helpers.h"
 #include "streams.h"
+#include "simd.h"
+#include "search.h"
+#include "snapshot.h"
+#include "stats.h"
 #include <cstdio>
-#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <limits>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/scoped_array.hpp>
 
 using namespace std;
 using namespace libstrings;
 
 namespace fs = boost::filesystem;
 
-_strings_handle_int::_strings_handle_int(const string& path, const string& fallbackEncoding) :
-    extStringDataArr(NULL),
-    extStringArr(NULL),
-    extString(NULL),
-    extStringDataArrSize(0),
-    extStringArrSize(0) {
+namespace {
+    //Parallel parsing is only worth it if each thread gets at least this many directory entries.
+    const uint32_t minEntriesPerThread = 4096;
+
+    //Compressed handles only compress strings at least this long, as shorter ones save little.
+    const uint32_t minCompressedLength = 32;
+
+    //Orders a snapshot's entries by ID, for searching them.
+    bool IdBelow(const snapshot_entry& entry, const uint32_t id) {
+        return entry.id < id;
+    }
+
+    //The part of the directory a thread parses, and what it finds.
+    struct parse_chunk {
+        parse_chunk() : first(0), last(0), errorCode(0) {}
+
+        uint32_t first;
+        uint32_t last;
+        vector< pair<uint32_t, string_entry> > entries;
+        string_arena arena;  //Holds the strings the thread transcodes.
+        decode_stats counts;
+
+        unsigned int errorCode;
+        string errorMessage;
+    };
+
+    //Gets the entry for a string, transcoding it into the arena if necessary.
+    string_entry DecodeString(const char * str, const bool isUTF8, const string& encoding, string_arena& arena, decode_stats& counts) {
+        string_entry entry;
+        const size_t length = strlen(str);
+        if (isUTF8)
+            counts.CountDecoded();
+
+        if (isUTF8 || counts.Validate(str, length)) {
+            entry.str = str;
+            entry.length = length;
+        } else {
+            const uint64_t start = Ticks();
+            const string transcoded = TranscodeToUTF8(str, length, encoding);
+            entry.str = arena.Append(transcoded.data(), transcoded.length());
+            entry.length = transcoded.length();
+            counts.AddTranscodeTicks(Ticks() - start);
+        }
+        return entry;
+    }
+
+    void ParseChunk(const char * fileContent, const size_t fileSize, const uint64_t startOfData, const bool isDotStrings, const bool isUTF8, const string& encoding, parse_chunk& chunk) {
+        try {
+            chunk.entries.reserve(chunk.last - chunk.first);
+            for (uint32_t i=chunk.first; i < chunk.last; i++) {
+                const char * entryPos = fileContent + sizeof(uint32_t) * 2 * (uint64_t(i) + 1);
+                const uint32_t id = *reinterpret_cast<const uint32_t*>(entryPos);
+                const uint32_t offset = *reinterpret_cast<const uint32_t*>(entryPos + sizeof(uint32_t));
+
+                const char * str = StringAt(fileContent, fileSize, startOfData, offset, isDotStrings);
+                if (str == NULL) {
+                    chunk.errorCode = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+                    return;
+                }
+
+                chunk.entries.push_back(pair<uint32_t, string_entry>(id, DecodeString(str, isUTF8, encoding, chunk.arena, chunk.counts)));
+            }
+        } catch (error& e) {
+            chunk.errorCode = e.code();
+            chunk.errorMessage = e.what();
+        } catch (bad_alloc& e) {
+            chunk.errorCode = LIBSTRINGS_ERROR_NO_MEM;
+            chunk.errorMessage = e.what();
+        } catch (exception& e) {
+            //Nothing else may escape, as the other threads must be joined.
+            chunk.errorCode = LIBSTRINGS_ERROR_BAD_STRING;
+            chunk.errorMessage = e.what();
+        }
+    }
+}
+
+namespace libstrings {
+    uint64_t FindDataBlock(const char * fileContent, const size_t fileSize, const string& path) {
+        //Check that the header and directory fit, and that the last string is terminated.
+        if (fileSize < sizeof(uint32_t) * 2)
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
+
+        const uint32_t dirCount = *reinterpret_cast<const uint32_t*>(fileContent);
+        const uint64_t startOfData = sizeof(uint32_t) * 2 * (uint64_t(dirCount) + 1);
+        if (startOfData > fileSize || (startOfData < fileSize && fileContent[fileSize - 1] != '\0'))
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
+
+        return startOfData;
+    }
+
+    const char * StringAt(const char * fileContent, const size_t fileSize, const uint64_t startOfData, const uint32_t offset, const bool isDotStrings) {
+        uint64_t strPos = startOfData + offset;
+        if (!isDotStrings)
+            strPos += sizeof(uint32_t);
+
+        //The file ends in a null byte, so any string that starts inside it is terminated.
+        if (strPos >= fileSize)
+            return NULL;
+        return fileContent + strPos;
+    }
+}
+
+_strings_handle_int::_strings_handle_int(const string& path, const string& fallbackEncoding, const unsigned int flags) :
+    fallbackEncoding(fallbackEncoding),
+    cache(1 << 20),
+    lazy((flags & LIBSTRINGS_OPEN_LAZY) != 0 && (flags & LIBSTRINGS_OPEN_COMPRESSED) == 0),
+    idIndexBuilt(NULL),
+    snapshotEntries(NULL),
+    snapshotCount(0),
+    snapshotStrings(NULL),
+    stats(&GlobalStats()),
+    sourceSize(0),
+    sourceTime(0),
+    sourceCount(0),
+    compactDataSize(0),
+    allDirty(false) {
 
     bool isDotStrings;
 
@@ -56,6 +175,28 @@ _strings_handle_int::_strings_handle_int(const string& path, const string& fallb
 
     //If the file already exists, parse it.
     if (fs::exists(path)) {
+        if (flags & LIBSTRINGS_OPEN_MAPPED) {
+            //Mapping an empty file fails, so reject it here. Directories and the like have no size.
+            boost::system::error_code ec;
+            if (fs::file_size(path, ec) == 0 || ec)
+                throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
+
+            try {
+                stat_timer timer(stats, STAT_READ_TIME);
+                mapping.open(path);
+            } catch (ios_base::failure& e) {
+                throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not map \"" + path + "\": " + e.what());
+            }
+            mappedPath = path;
+            stats.Add(STAT_BYTES_READ, mapping.size());
+
+            Parse(mapping.data(), mapping.size(), isDotStrings, flags, path);
+            SetSource(path, fallbackEncoding, *reinterpret_cast<const uint32_t*>(mapping.data()), mapping.size() - FindDataBlock(mapping.data(), mapping.size(), path));
+            if (flags & LIBSTRINGS_OPEN_COMPRESSED)
+                Compress();
+            return;
+        }
+
         libstrings::ifstream in(fs::path(path), ios::binary);
         in.exceptions(ios::failbit | ios::badbit | ios::eofbit);  //Causes ifstream::failure to be thrown if problem is encountered.
 
@@ -64,105 +205,996 @@ _strings_handle_int::_strings_handle_int(const string& path, const string& fallb
         holds all the strings at their offsets.
         Loop through the directory and for each entry, record the ID,
         look up the string using the offset and store that.
-        Quickest to read whole file into memory, parse it from there
-        then free that memory. Jumping around inside a file stream is
-        a bit slower. */
-        uint8_t * fileContent;
+        Quickest to read whole file into memory and parse it from there.
+        Jumping around inside a file stream is a bit slower. The buffer
+        becomes part of the arena, so strings that don't need transcoding
+        are used where they are instead of being copied. */
+        char * fileContent;
         uint32_t fileSize;
 
         //Get the file's length.
         in.seekg(0, ios::end);
         fileSize = in.tellg();
+        if (fileSize == 0)
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
 
         //Allocate memory.
         try {
-            fileContent = new uint8_t[fileSize];
+            fileContent = new char[fileSize];
+            arena.Adopt(fileContent, fileSize);
         } catch (bad_alloc& e) {
             throw error(LIBSTRINGS_ERROR_NO_MEM, e.what());
         }
 
         //Read whole file into memory.
-        in.seekg(0, ios::beg);
-        in.read((char*)fileContent, fileSize);
+        {
+            stat_timer timer(stats, STAT_READ_TIME);
+            in.seekg(0, ios::beg);
+            in.read(fileContent, fileSize);
+        }
+        stats.Add(STAT_BYTES_READ, fileSize);
 
         in.close();
 
-        //Get number of directory entries.
-        uint32_t dirCount = *reinterpret_cast<uint32_t*>(fileContent);
+        Parse(fileContent, fileSize, isDotStrings, flags, path);
+        SetSource(path, fallbackEncoding, *reinterpret_cast<const uint32_t*>(fileContent), fileSize - FindDataBlock(fileContent, fileSize, path));
+        if (flags & LIBSTRINGS_OPEN_COMPRESSED)
+            Compress();
+    }
+}
+
+void _strings_handle_int::Parse(const char * fileContent, const size_t fileSize, const bool isDotStrings, const unsigned int flags, const string& path) {
+    stat_timer timer(stats, STAT_PARSE_TIME);
+    const uint64_t startOfData = FindDataBlock(fileContent, fileSize, path);
+
+    //Get number of directory entries.
+    const uint32_t dirCount = *reinterpret_cast<const uint32_t*>(fileContent);
+    uint32_t pos = sizeof(uint32_t) * 2;
+
+    const bool isUTF8 = boost::iequals("UTF-8", fallbackEncoding);
+    const bool findUnref = (flags & LIBSTRINGS_OPEN_UNREF_STRINGS) != 0;
+
+    //Lazily-opened handles don't decode anything, so have nothing to parallelise.
+    size_t numThreads = 1;
+    if ((flags & LIBSTRINGS_OPEN_PARALLEL) && !lazy)
+        numThreads = max<size_t>(1, min<size_t>(boost::thread::hardware_concurrency(), dirCount / minEntriesPerThread));
+
+    //Referenced offsets are only needed to find the unreferenced strings.
+    vector<uint32_t> offsets;
+    if (findUnref)
+        offsets.reserve(dirCount);
+
+    data.rehash(dirCount);
+    if (numThreads > 1) {
+        /* Split the directory between the threads, which each check and
+           transcode their strings. Validating each string in its thread is
+           quicker than first validating the whole data block on this one.
+           If a thread can't be started, its chunk is parsed on this thread. */
+        boost::scoped_array<parse_chunk> chunks(new parse_chunk[numThreads]);
+        for (size_t i=0; i < numThreads; i++) {
+            chunks[i].first = dirCount / numThreads * i;
+            chunks[i].last = (i + 1 == numThreads) ? dirCount : dirCount / numThreads * (i + 1);
+        }
+
+        boost::thread_group threads;
+        size_t started = 1;
+        try {
+            for (; started < numThreads; started++)
+                threads.create_thread(boost::bind(ParseChunk, fileContent, fileSize, startOfData, isDotStrings, isUTF8, boost::cref(fallbackEncoding), boost::ref(chunks[started])));
+        } catch (boost::thread_resource_error&) {}
+
+        ParseChunk(fileContent, fileSize, startOfData, isDotStrings, isUTF8, fallbackEncoding, chunks[0]);
+        for (size_t i=started; i < numThreads; i++)
+            ParseChunk(fileContent, fileSize, startOfData, isDotStrings, isUTF8, fallbackEncoding, chunks[i]);
+        threads.join_all();
+
+        //Merge the chunks in order, so that the first of any duplicate IDs is kept.
+        for (size_t i=0; i < numThreads; i++) {
+            if (chunks[i].errorCode == LIBSTRINGS_ERROR_FILE_READ_FAIL && chunks[i].errorMessage.empty())
+                throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
+            else if (chunks[i].errorCode != 0)
+                throw error(chunks[i].errorCode, chunks[i].errorMessage);
+        }
+        for (size_t i=0; i < numThreads; i++) {
+            data.insert(chunks[i].entries.begin(), chunks[i].entries.end());
+            arena.Merge(chunks[i].arena);
+            chunks[i].counts.AddTo(stats);
+        }
+
+        if (findUnref) {
+            for (; pos < startOfData; pos += 2 * sizeof(uint32_t))
+                offsets.push_back(*reinterpret_cast<const uint32_t*>(fileContent + pos + sizeof(uint32_t)));
+        }
+    } else {
+        /* A STRINGS file's data block is just null-terminated strings, so if
+           the whole block is valid UTF-8 then so is every string in it, and
+           they needn't be checked individually. The length prefixes in
+           DLSTRINGS and ILSTRINGS files are binary, so their strings are
+           checked one by one. Lazily-opened handles just record where each
+           string is. */
+        decode_stats counts;
+        bool allUTF8 = !lazy && isUTF8;
+        if (!lazy && !isUTF8 && isDotStrings) {
+            const uint64_t start = Ticks();
+            allUTF8 = IsValidUTF8(fileContent + startOfData, fileSize - startOfData);
+            counts.AddValidateTicks(Ticks() - start);
+        }
 
-        uint32_t pos = sizeof(uint32_t) * 2;
-        uint32_t startOfData = sizeof(uint32_t) * 2 * (dirCount + 1);
-        boost::unordered_set<uint32_t> offsets;
         while (pos < startOfData) {
-            string str;
-            uint32_t id = *reinterpret_cast<uint32_t*>(fileContent + pos);
-            uint32_t offset = *reinterpret_cast<uint32_t*>(fileContent + pos + sizeof(uint32_t));
-            uint32_t strPos = startOfData + offset;
-            if (!isDotStrings)
-                strPos += sizeof(uint32_t);
-
-            //Find position of null pointer.
-            char * nptr = strchr((char*)(fileContent + strPos), '\0');
-            if (nptr == NULL)
+            uint32_t id = *reinterpret_cast<const uint32_t*>(fileContent + pos);
+            uint32_t offset = *reinterpret_cast<const uint32_t*>(fileContent + pos + sizeof(uint32_t));
+
+            const char * str = StringAt(fileContent, fileSize, startOfData, offset, isDotStrings);
+            if (str == NULL)
                 throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
 
             //Now set string, transcoding if necessary.
-            str = ToUTF8(string((char*)(fileContent + strPos), nptr - (char*)(fileContent + strPos)), fallbackEncoding);
-
-            data.insert(pair<uint32_t, string>(id, str));
-            offsets.insert(offset);
+            if (data.find(id) == data.end()) {
+                string_entry entry;
+                if (lazy) {
+                    entry.str = str;
+                    entry.length = string_entry::undecoded;
+                } else
+                    entry = DecodeString(str, allUTF8, fallbackEncoding, arena, counts);
+                data.insert(pair<uint32_t, string_entry>(id, entry));
+            }
+            if (findUnref)
+                offsets.push_back(offset);
 
             pos += 2 * sizeof(uint32_t);
         }
+        counts.AddTo(stats);
+    }
 
-        //Now before we delete the contents, let's look for unreferenced strings.
-        pos = startOfData;
-        boost::unordered_set<uint32_t>::iterator endIt = offsets.end();
-        while (pos < fileSize) {
-            stringstream out;
-            string str;
+    if (!findUnref)
+        return;
 
-            if (isDotStrings)
-                out << fileContent + pos;
-            else
-                out << fileContent + pos + sizeof(uint32_t);
-            str = out.str();
+    /* Now let's look for unreferenced strings. The strings in the data block
+       are in offset order, so walk through it once, stepping through the
+       sorted referenced offsets alongside. */
+    sort(offsets.begin(), offsets.end());
+    vector<uint32_t>::const_iterator offsetIt = offsets.begin(), offsetEnd = offsets.end();
+    const size_t prefixSize = isDotStrings ? 0 : sizeof(uint32_t);
+    uint64_t strStart = startOfData;
+    while (strStart + prefixSize < fileSize) {
+        const char * str = fileContent + strStart + prefixSize;
+        const char * end = static_cast<const char*>(memchr(str, '\0', fileContent + fileSize - str));
+        const uint32_t offset = strStart - startOfData;
+
+        while (offsetIt != offsetEnd && *offsetIt < offset)
+            ++offsetIt;
+        if (offsetIt == offsetEnd || *offsetIt != offset)
+            unrefStrings.emplace(ToUTF8(string(str, end), fallbackEncoding));
+
+        strStart = end + 1 - fileContent;
+    }
+}
 
-            if (offsets.find(pos - startOfData) == endIt)
-                unrefStrings.emplace(ToUTF8(str, fallbackEncoding));
+/* The snapshot's strings are already decoded and its directory checked,
+   so the strings are used from its mapping as they are, and nothing is
+   read until they're looked up. The strings file it was saved from
+   becomes the handle's source, as if it had been read. */
+_strings_handle_int::_strings_handle_int(const snapshot_file& snapshot, const string& path) :
+    mapping(snapshot.Mapping()),
+    mappedPath(snapshot.path),
+    fallbackEncoding("UTF-8"),
+    cache(1 << 20),
+    lazy(false),
+    idIndexBuilt(NULL),
+    snapshotEntries(snapshot.Entries()),
+    snapshotCount(snapshot.Header().count),
+    snapshotStrings(snapshot.Strings()),
+    stats(&GlobalStats()),
+    sourcePath(path),
+    sourceSize(snapshot.Header().sourceSize),
+    sourceTime(snapshot.Header().sourceTime),
+    sourceEncoding(snapshot.Header().sourceEncoding, find(snapshot.Header().sourceEncoding, snapshot.Header().sourceEncoding + sizeof(snapshot.Header().sourceEncoding), '\0')),
+    sourceCount(snapshot.Header().sourceCount),
+    compactDataSize(snapshot.Header().sourceDataSize),
+    allDirty(false) {
+
+    stats.Add(STAT_BYTES_READ, mapping.size());
+}
+
+_strings_handle_int::~_strings_handle_int() {
+    decodeCounts.AddTo(stats);
+
+    for (boost::unordered_map<boost::thread::id, export_slots*>::iterator it=exports.begin(), endIt=exports.end(); it != endIt; ++it)
+        delete it->second;
+}
+
+export_slots::export_slots() :
+    stringDataArr(NULL),
+    stringArr(NULL),
+    string(NULL),
+    stringDataArrSize(0),
+    stringArrSize(0) {}
+
+export_slots::~export_slots() {
+    FreeStringDataArr();
+    FreeStringArr();
+    FreeString();
+}
+
+void export_slots::FreeStringDataArr() {
+    if (stringDataArr != NULL) {
+        for (size_t i=0; i < stringDataArrSize; i++)
+            delete [] stringDataArr[i].data;
+        delete [] stringDataArr;
+        stringDataArr = NULL;
+        stringDataArrSize = 0;
+    }
+}
+
+void export_slots::FreeStringArr() {
+    if (stringArr != NULL) {
+        for (size_t i=0; i < stringArrSize; i++)
+            delete [] stringArr[i];
+        delete [] stringArr;
+        stringArr = NULL;
+        stringArrSize = 0;
+    }
+}
+
+void export_slots::FreeString() {
+    if (string != NULL) {
+        delete [] string;
+        string = NULL;
+    }
+}
+
+export_slots& _strings_handle_int::Exports() {
+    boost::lock_guard<boost::mutex> lock(exportsMutex);
+
+    export_slots *& slots = exports[boost::this_thread::get_id()];
+    if (slots == NULL)
+        slots = new export_slots();
+    return *slots;
+}
 
-            pos += str.length() + 1;
-            if (!isDotStrings)
-                pos += sizeof(uint32_t);
+bool _strings_handle_int::DecodesOnAccess() const {
+    return lazy || symbols;
+}
+
+/* Resolve() counts into decodeCounts, which is only added to the handle's
+   stats here, so that first accesses don't each make atomic adds. Only
+   lazily-opened handles decode anything in Resolve(). */
+void _strings_handle_int::GetStats(st_stats& out) {
+    if (lazy) {
+        boost::lock_guard<boost::mutex> lock(decodeMutex);
+        decodeCounts.AddTo(stats);
+        decodeCounts = decode_stats();
+    }
+    stats.Get(out);
+}
+
+/* Returns the UTF-8 string for an entry, decoding it on first access. Strings
+   that need transcoding or decompressing are kept in the cache, so the
+   returned pointer is only valid until the next call. */
+const char * _strings_handle_int::Resolve(const uint32_t id, string_entry& entry, size_t& length) {
+    if (entry.length == string_entry::undecoded) {
+        const size_t rawLength = strlen(entry.str);
+        const bool isUTF8 = boost::iequals("UTF-8", fallbackEncoding);
+        if (isUTF8)
+            decodeCounts.CountDecoded();
+
+        if (isUTF8 || decodeCounts.Validate(entry.str, rawLength))
+            entry.length = rawLength;
+        else
+            entry.length = string_entry::transcoded;
+    }
+
+    if (!entry.IsCached()) {
+        length = entry.length;
+        return entry.str;
+    }
+
+    const string * decoded = cache.Get(id);
+    if (decoded == NULL && entry.length == string_entry::compressed)
+        decoded = &cache.Put(id, Decompress(entry));
+    else if (decoded == NULL) {
+        const uint64_t start = Ticks();
+        decoded = &cache.Put(id, TranscodeToUTF8(entry.str, strlen(entry.str), fallbackEncoding));
+        decodeCounts.AddTranscodeTicks(Ticks() - start);
+    }
+
+    length = decoded->length();
+    return decoded->c_str();
+}
+
+/* Strings in the cache may be evicted by later lookups, so copy them into
+   the arena. The entry then refers to the decoded string, which is also
+   what Save() and Compact() expect of it. */
+const char * _strings_handle_int::Pin(const uint32_t id, string_entry& entry, size_t& length) {
+    boost::unique_lock<boost::mutex> lock(decodeMutex, boost::defer_lock);
+    if (DecodesOnAccess())
+        lock.lock();
+
+    const char * str = Resolve(id, entry, length);
+    if (entry.IsCached()) {
+        entry.str = arena.Append(str, length);
+        entry.length = length;
+        cache.Erase(id);
+        str = entry.str;
+    }
+    return str;
+}
+
+char * _strings_handle_int::Copy(const uint32_t id, string_entry& entry) {
+    //The string may be in the cache, so copy it before anything else can evict it.
+    boost::unique_lock<boost::mutex> lock(decodeMutex, boost::defer_lock);
+    if (DecodesOnAccess())
+        lock.lock();
+
+    //Compressed strings are decompressed straight into the copy, rather than through the cache.
+    if (entry.length == string_entry::compressed) {
+        compressed_string header;
+        memcpy(&header, entry.str, sizeof(header));
+
+        char * copy = new char[header.length + symbol_table::maxOverrun + 1];
+        symbols->Decompress(entry.str + sizeof(header), header.size, copy);
+        copy[header.length] = '\0';
+        return copy;
+    }
+
+    size_t length;
+    const char * str = Resolve(id, entry, length);
+    return ToNewCString(str, length);
+}
+
+void _strings_handle_int::Set(const uint32_t id, const char * str, const size_t length) {
+    Unpack();
+    dirty.insert(id);
+
+    string_entry entry;
+    entry.str = arena.Append(str, length);
+    entry.length = length;
+
+    cache.Erase(id);
+    data[id] = entry;
+    Invalidate();
+}
+
+void _strings_handle_int::SetAll(const st_string_data * strings, const size_t numStrings) {
+    //Build the new strings in a new arena, so nothing changes if an ID is duplicated.
+    entry_map newData;
+    string_arena newArena;
+
+    newData.rehash(numStrings);
+    for (size_t i=0; i < numStrings; i++) {
+        string_entry entry;
+        entry.length = strlen(strings[i].data);
+        entry.str = newArena.Append(strings[i].data, entry.length);
+        if (!newData.insert(pair<uint32_t, string_entry>(strings[i].id, entry)).second)
+            throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "The ID given for the string \"" + string(strings[i].data) + "\" already exists.");
+    }
+
+    //Nothing refers to the old strings now.
+    data.swap(newData);
+    arena.Swap(newArena);
+    snapshotStrings = NULL;
+    allDirty = true;
+    cache.Clear();
+    Invalidate();
+    if (mapping.is_open())
+        mapping.close();
+    mappedPath.clear();
+}
+
+bool _strings_handle_int::Erase(const uint32_t id) {
+    string_entry scratch;
+    if (Find(id, scratch) == NULL)
+        return false;
+
+    Unpack();
+    dirty.insert(id);
+    data.erase(id);
+    cache.Erase(id);
+    Invalidate();
+    return true;
+}
+
+/* Checks all the edits before changing anything. Edits are applied in order,
+   so an edit may act on an ID that an earlier edit added or removed. Once
+   they're known to be valid, the net change to each ID is applied. */
+bool _strings_handle_int::ApplyEdits(const st_string_edit * edits, const size_t numEdits, vector<uint8_t>& statuses) {
+    //For each ID edited, whether it exists after the edits and which edit last set its string.
+    struct edited_id {
+        bool exists;
+        size_t edit;
+    };
+    boost::unordered_map<uint32_t, edited_id> edited;
+    vector<size_t> lengths(numEdits);
+    bool valid = true;
+    string_entry scratch;
+
+    statuses.assign(numEdits, uint8_t(LIBSTRINGS_OK));
+    edited.rehash(numEdits);
+    for (size_t i=0; i < numEdits; i++) {
+        const st_string_edit& edit = edits[i];
+
+        boost::unordered_map<uint32_t, edited_id>::iterator it = edited.find(edit.id);
+        const bool exists = (it != edited.end()) ? it->second.exists : (Find(edit.id, scratch) != NULL);
+
+        bool ok;
+        if (edit.op == LIBSTRINGS_EDIT_ADD)
+            ok = !exists && edit.data != NULL;
+        else if (edit.op == LIBSTRINGS_EDIT_REPLACE)
+            ok = exists && edit.data != NULL;
+        else if (edit.op == LIBSTRINGS_EDIT_REMOVE)
+            ok = exists;
+        else
+            ok = false;
+
+        if (!ok) {
+            statuses[i] = uint8_t(LIBSTRINGS_ERROR_INVALID_ARGS);
+            valid = false;
+            continue;
+        }
+
+        edited_id result;
+        result.exists = (edit.op != LIBSTRINGS_EDIT_REMOVE);
+        result.edit = i;
+        if (result.exists)
+            lengths[i] = strlen(edit.data);
+
+        if (it != edited.end())
+            it->second = result;
+        else
+            edited.insert(pair<uint32_t, edited_id>(edit.id, result));
+    }
+
+    if (!valid)
+        return false;
+    Unpack();
+
+    //Copy the new strings into the arena, then make the changes.
+    vector< pair<uint32_t, string_entry> > changed;
+    vector<uint32_t> removed;
+    changed.reserve(edited.size());
+    for (boost::unordered_map<uint32_t, edited_id>::iterator it=edited.begin(), endIt=edited.end(); it != endIt; ++it) {
+        if (!it->second.exists) {
+            if (data.find(it->first) != data.end())
+                removed.push_back(it->first);
+            continue;
         }
 
-        delete [] fileContent;
+        const size_t i = it->second.edit;
+        string_entry entry;
+        entry.str = arena.Append(edits[i].data, lengths[i]);
+        entry.length = lengths[i];
+        changed.push_back(pair<uint32_t, string_entry>(it->first, entry));
     }
+
+    Commit(changed, removed);
+    return true;
 }
 
-_strings_handle_int::~_strings_handle_int() {
-    if (extString != NULL)
-        delete [] extString;
+/* Copies the selected strings of src into this handle, in one pass over
+   src's entries. Strings shared between IDs in src are only copied once. */
+void _strings_handle_int::Overlay(_strings_handle_int& src, const st_overlay_selector& selector, const bool addMissing) {
+    pattern_matcher prefixes;
+    boost::unordered_set<uint32_t> ids;
+    if (selector.type == LIBSTRINGS_SELECT_PREFIXES) {
+        for (size_t i=0; i < selector.numPrefixes; i++)
+            prefixes.AddPrefix(selector.prefixes[i], strlen(selector.prefixes[i]));
+    } else if (selector.type == LIBSTRINGS_SELECT_IDS)
+        ids.insert(selector.ids, selector.ids + selector.numIds);
+
+    //Strings from src's decode cache are copied before the next lookup can evict them.
+    boost::unique_lock<boost::mutex> srcLock(src.decodeMutex, boost::defer_lock);
+    if (src.DecodesOnAccess())
+        srcLock.lock();
+
+    Unpack();
+
+    vector< pair<uint32_t, string_entry> > changed;
+    boost::unordered_map<const char *, const char *> copied;
+    for (entry_walker walker(src); !walker.AtEnd(); walker.Next()) {
+        const uint32_t id = walker.Id();
+        entry_map::iterator dstIt = data.find(id);
+        if (dstIt == data.end() && !addMissing)
+            continue;
+
+        st_string_view srcView;
+        srcView.id = id;
+        srcView.data = src.Resolve(id, walker.Entry(), srcView.length);
+
+        //The destination string is only needed if the selector looks at it.
+        st_string_view dstView;
+        const st_string_view * dstString = NULL;
+        if (dstIt != data.end() && (selector.type == LIBSTRINGS_SELECT_CALLBACK || (selector.type == LIBSTRINGS_SELECT_PREFIXES && !selector.matchSource))) {
+            dstView.id = id;
+            dstView.data = Resolve(id, dstIt->second, dstView.length);
+            dstString = &dstView;
+        }
+
+        bool selected = true;
+        if (selector.type == LIBSTRINGS_SELECT_PREFIXES) {
+            const st_string_view * matched = selector.matchSource ? &srcView : dstString;
+            selected = matched != NULL && prefixes.Matches(matched->data, matched->length);
+        } else if (selector.type == LIBSTRINGS_SELECT_IDS)
+            selected = ids.find(id) != ids.end();
+        else if (selector.type == LIBSTRINGS_SELECT_CALLBACK)
+            selected = selector.callback(selector.userdata, dstString, &srcView) != 0;
+
+        if (selected == selector.invert)
+            continue;
+
+        string_entry entry;
+        entry.length = srcView.length;
+        if (walker.Entry().IsCached())
+            entry.str = arena.Append(srcView.data, srcView.length);
+        else {
+            pair<boost::unordered_map<const char *, const char *>::iterator, bool> result = copied.insert(pair<const char *, const char *>(srcView.data, NULL));
+            if (result.second)
+                result.first->second = arena.Append(srcView.data, srcView.length);
+            entry.str = result.first->second;
+        }
+        changed.push_back(pair<uint32_t, string_entry>(id, entry));
+    }
+
+    Commit(changed, vector<uint32_t>());
+}
+
+/* Transcoded and compressed strings are matched in the decode cache rather
+   than being copied into the arena, as only their IDs are output. */
+void _strings_handle_int::Filter(const pattern_matcher& matcher, vector<uint32_t>& ids) {
+    ids.clear();
+
+    boost::unique_lock<boost::mutex> lock(decodeMutex, boost::defer_lock);
+    if (DecodesOnAccess())
+        lock.lock();
+
+    for (entry_walker walker(*this); !walker.AtEnd(); walker.Next()) {
+        size_t length;
+        const char * str = Resolve(walker.Id(), walker.Entry(), length);
+        if (matcher.Matches(str, length))
+            ids.push_back(walker.Id());
+    }
+}
+
+/* The index holds its own folded copy of every string, in ascending order
+   of ID. Modifying the handle frees it, to be rebuilt by the next search. */
+void _strings_handle_int::BuildSearchIndex() {
+    boost::lock_guard<boost::mutex> lock(searchMutex);
+    if (searchIndex)
+        return;
+
+    boost::scoped_ptr<search_index> index(new search_index());
+    {
+        boost::unique_lock<boost::mutex> decodeLock(decodeMutex, boost::defer_lock);
+        if (DecodesOnAccess())
+            decodeLock.lock();
+
+        for (entry_walker walker(*this, true); !walker.AtEnd(); walker.Next()) {
+            size_t length;
+            const char * str = Resolve(walker.Id(), walker.Entry(), length);
+            index->Add(walker.Id(), str, length);
+        }
+    }
+    index->Build();
+    searchIndex.swap(index);
+}
+
+/* The index ignores case, so for a case-sensitive search the strings it
+   finds are checked against the query again. */
+void _strings_handle_int::Search(const char * query, const size_t length, const bool ignoreCase, vector<uint32_t>& ids) {
+    BuildSearchIndex();
+    searchIndex->Find(query, length, ids);
+    if (ignoreCase || length == 0)
+        return;
+
+    pattern_matcher matcher;
+    matcher.AddSubstring(query, length);
+
+    boost::unique_lock<boost::mutex> lock(decodeMutex, boost::defer_lock);
+    if (DecodesOnAccess())
+        lock.lock();
+
+    size_t kept = 0;
+    string_entry scratch;
+    for (size_t i=0; i < ids.size(); i++) {
+        size_t strLength;
+        const char * str = Resolve(ids[i], *Find(ids[i], scratch), strLength);
+        if (matcher.Matches(str, strLength))
+            ids[kept++] = ids[i];
+    }
+    ids.resize(kept);
+}
+
+void _strings_handle_int::Invalidate() {
+    searchIndex.reset();
+    idIndexBuilt.store(NULL, boost::memory_order_relaxed);
+    idIndex.reset();
+    contentHashes.reset();
+    snapshotEntries = NULL;
+}
+
+bool _strings_handle_int::FromSnapshot() const {
+    return snapshotStrings != NULL;
+}
+
+size_t _strings_handle_int::Size() const {
+    return FromSnapshot() ? snapshotCount : data.size();
+}
 
-    if (extStringDataArr != NULL) {
-        for (size_t i=0; i < extStringDataArrSize; i++)
-            delete [] extStringDataArr[i].data;
-        delete [] extStringDataArr;
+//The strings stay in the mapping, and the snapshot's hashes stay in use until the handle is invalidated.
+void _strings_handle_int::Unpack() {
+    if (!FromSnapshot())
+        return;
+
+    try {
+        data.rehash(snapshotCount);
+        for (uint32_t i=0; i < snapshotCount; i++) {
+            string_entry entry;
+            entry.str = snapshotStrings + snapshotEntries[i].offset;
+            entry.length = snapshotEntries[i].length;
+            data.insert(pair<uint32_t, string_entry>(snapshotEntries[i].id, entry));
+        }
+    } catch (bad_alloc&) {
+        data.clear();
+        throw;
+    }
+    snapshotStrings = NULL;
+}
+
+const id_index * _strings_handle_int::IdIndex() const {
+    return idIndexBuilt.load(boost::memory_order_acquire);
+}
+
+//Searching the index's tree is slower than the map, so the index is only used if it looks up IDs directly.
+string_entry * _strings_handle_int::Find(const uint32_t id, string_entry& scratch) {
+    if (FromSnapshot()) {
+        const snapshot_entry * end = snapshotEntries + snapshotCount;
+        const snapshot_entry * entry = lower_bound(snapshotEntries, end, id, IdBelow);
+        if (entry == end || entry->id != id)
+            return NULL;
+
+        scratch.str = snapshotStrings + entry->offset;
+        scratch.length = entry->length;
+        return &scratch;
+    }
+
+    const id_index * index = IdIndex();
+    if (index != NULL && index->IsDirect())
+        return index->Find(id);
+
+    entry_map::iterator it = data.find(id);
+    return it == data.end() ? NULL : &it->second;
+}
+
+/* The entries are in the map's nodes, which don't move as the map grows,
+   so the index only needs rebuilding when IDs are added or removed. It's
+   rebuilt whenever the handle is modified anyway, as the search index is. */
+const id_index * _strings_handle_int::BuildIdIndex() {
+    if (FromSnapshot())
+        return NULL;
+
+    boost::lock_guard<boost::mutex> lock(idIndexMutex);
+    if (idIndex)
+        return idIndex.get();
+
+    vector< pair<uint32_t, string_entry *> > sorted;
+    sorted.reserve(data.size());
+    for (entry_map::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it)
+        sorted.push_back(pair<uint32_t, string_entry *>(it->first, &it->second));
+    sort(sorted.begin(), sorted.end());
+
+    boost::scoped_ptr<id_index> index(new id_index());
+    for (size_t i=0; i < sorted.size(); i++)
+        index->Add(sorted[i].first, sorted[i].second);
+    index->Build();
+
+    idIndex.swap(index);
+    idIndexBuilt.store(idIndex.get(), boost::memory_order_release);
+    return idIndex.get();
+}
+
+void _strings_handle_int::GetRange(const uint32_t lo, const uint32_t hi, vector<st_string_view>& views) {
+    views.clear();
+    if (FromSnapshot()) {
+        const snapshot_entry * end = snapshotEntries + snapshotCount;
+        for (const snapshot_entry * entry=lower_bound(snapshotEntries, end, lo, IdBelow); entry != end && entry->id <= hi; ++entry) {
+            st_string_view view;
+            view.id = entry->id;
+            view.data = snapshotStrings + entry->offset;
+            view.length = entry->length;
+            views.push_back(view);
+        }
+        return;
     }
 
-    if (extStringArr != NULL) {
-        for (size_t i=0; i < extStringArrSize; i++)
-            delete [] extStringArr[i];
-        delete [] extStringArr;
+    const id_index& index = *BuildIdIndex();
+    for (size_t node=index.LowerBound(lo); node != 0 && index.IdAt(node) <= hi; node=index.Next(node)) {
+        st_string_view view;
+        view.id = index.IdAt(node);
+        view.data = Pin(view.id, *index.EntryAt(node), view.length);
+        views.push_back(view);
+    }
+}
+
+/* A snapshot's entries are in ascending order of ID, and are only used
+   while the handle still holds exactly them. Other handles hash each
+   string as it's resolved, so transcoded strings aren't kept. */
+void _strings_handle_int::BuildContentHashes() {
+    boost::lock_guard<boost::mutex> lock(contentHashesMutex);
+    if (contentHashes)
+        return;
+
+    boost::scoped_ptr< vector< pair<uint32_t, uint64_t> > > hashes(new vector< pair<uint32_t, uint64_t> >());
+    hashes->reserve(Size());
+    if (snapshotEntries != NULL) {
+        for (size_t i=0; i < snapshotCount; i++)
+            hashes->push_back(pair<uint32_t, uint64_t>(snapshotEntries[i].id, snapshotEntries[i].hash));
+    } else {
+        {
+            boost::unique_lock<boost::mutex> decodeLock(decodeMutex, boost::defer_lock);
+            if (DecodesOnAccess())
+                decodeLock.lock();
+
+            for (entry_map::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+                size_t length;
+                const char * str = Resolve(it->first, it->second, length);
+                hashes->push_back(pair<uint32_t, uint64_t>(it->first, HashBytes(str, length)));
+            }
+        }
+        sort(hashes->begin(), hashes->end());
+    }
+    contentHashes.swap(hashes);
+}
+
+//Both handles' hashes are in ascending order of ID, so they're merged in one pass.
+void _strings_handle_int::Diff(_strings_handle_int& other, vector<uint32_t>& added, vector<uint32_t>& removed, vector<uint32_t>& changed) {
+    added.clear();
+    removed.clear();
+    changed.clear();
+
+    BuildContentHashes();
+    other.BuildContentHashes();
+    const vector< pair<uint32_t, uint64_t> >& from = *contentHashes;
+    const vector< pair<uint32_t, uint64_t> >& to = *other.contentHashes;
+
+    size_t i=0, j=0;
+    while (i < from.size() && j < to.size()) {
+        if (from[i].first < to[j].first) {
+            removed.push_back(from[i].first);
+            i++;
+        } else if (to[j].first < from[i].first) {
+            added.push_back(to[j].first);
+            j++;
+        } else {
+            if (from[i].second != to[j].second)
+                changed.push_back(from[i].first);
+            i++;
+            j++;
+        }
+    }
+    for (; i < from.size(); i++)
+        removed.push_back(from[i].first);
+    for (; j < to.size(); j++)
+        added.push_back(to[j].first);
+}
+
+/* Marking the IDs dirty and adding the new IDs are the only steps that
+   allocate, so they're done first. If adding an ID fails, the IDs already
+   added are removed again, and the dirty marks and any strings the caller
+   copied into the arena are just unused. */
+void _strings_handle_int::Commit(const vector< pair<uint32_t, string_entry> >& changed, const vector<uint32_t>& removed) {
+    Unpack();
+
+    size_t numAdded = 0;
+    for (size_t i=0; i < changed.size(); i++) {
+        if (data.find(changed[i].first) == data.end())
+            numAdded++;
+    }
+
+    vector<uint32_t> added;
+    added.reserve(numAdded);
+    try {
+        data.reserve(data.size() + numAdded);
+
+        for (size_t i=0; i < changed.size(); i++)
+            dirty.insert(changed[i].first);
+        for (size_t i=0; i < removed.size(); i++)
+            dirty.insert(removed[i]);
+
+        for (size_t i=0; i < changed.size(); i++) {
+            if (data.insert(changed[i]).second)
+                added.push_back(changed[i].first);
+        }
+    } catch (bad_alloc&) {
+        for (size_t i=0; i < added.size(); i++)
+            data.erase(added[i]);
+        throw;
+    }
+
+    //Now replace and remove strings, neither of which can fail.
+    for (size_t i=0; i < changed.size(); i++) {
+        data.find(changed[i].first)->second = changed[i].second;
+        cache.Erase(changed[i].first);
+    }
+    for (size_t i=0; i < removed.size(); i++) {
+        data.erase(removed[i]);
+        cache.Erase(removed[i]);
+    }
+    Invalidate();
+}
+
+bool _strings_handle_int::IsMapped(const char * str) const {
+    return mapping.is_open() && str >= mapping.data() && str < mapping.data() + mapping.size();
+}
+
+//The length of an entry's bytes as stored, which is unknown for undecoded or transcoded strings.
+size_t _strings_handle_int::RawLength(const string_entry& entry) const {
+    if (entry.length == string_entry::compressed) {
+        compressed_string header;
+        memcpy(&header, entry.str, sizeof(header));
+        return sizeof(header) + header.size;
+    }
+    if (entry.length == string_entry::undecoded || entry.length == string_entry::transcoded)
+        return strlen(entry.str);
+    return entry.length;
+}
+
+string _strings_handle_int::Decompress(const string_entry& entry) const {
+    compressed_string header;
+    memcpy(&header, entry.str, sizeof(header));
+
+    string str(header.length + symbol_table::maxOverrun, '\0');
+    symbols->Decompress(entry.str + sizeof(header), header.size, &str[0]);
+    str.resize(header.length);
+    return str;
+}
+
+//codes is used to build the compressed string, so that its memory is reused between calls.
+const char * _strings_handle_int::AppendCompressed(string_arena& target, const char * str, const size_t length, string& codes) const {
+    compressed_string header;
+    codes.assign(sizeof(header), '\0');
+    symbols->Compress(str, length, codes);
+    if (codes.length() >= length)
+        return NULL;
+
+    header.size = codes.length() - sizeof(header);
+    header.length = length;
+    memcpy(&codes[0], &header, sizeof(header));
+    return target.Append(codes.data(), codes.length());
+}
+
+void _strings_handle_int::Compact() {
+    /* Copy each string into a new arena, keeping strings that are shared
+       between IDs shared. Compressed handles also compress the long strings
+       that aren't already, including any in the mapped file. Entries are
+       only updated once everything has been copied, so running out of
+       memory leaves the handle as it was. A snapshot's strings are all in
+       the mapping, so there's nothing to copy. */
+    if (FromSnapshot())
+        return;
+
+    string_arena newArena;
+    boost::unordered_map<const char *, string_entry> moved;
+    vector<string_entry> newEntries;
+    string codes;
+    newEntries.reserve(data.size());
+
+    for (entry_map::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+        const string_entry& entry = it->second;
+        if (!symbols && IsMapped(entry.str)) {
+            newEntries.push_back(entry);
+            continue;
+        }
+
+        boost::unordered_map<const char *, string_entry>::iterator movedIt = moved.find(entry.str);
+        if (movedIt != moved.end()) {
+            newEntries.push_back(movedIt->second);
+            continue;
+        }
+
+        //Compressed handles don't have undecoded or transcoded strings, so the length is a real one unless compressed.
+        string_entry newEntry = entry;
+        newEntry.str = NULL;
+        if (symbols && entry.length != string_entry::compressed && entry.length >= minCompressedLength) {
+            newEntry.str = AppendCompressed(newArena, entry.str, entry.length, codes);
+            if (newEntry.str != NULL)
+                newEntry.length = string_entry::compressed;
+        }
+        if (newEntry.str == NULL)
+            newEntry.str = newArena.Append(entry.str, RawLength(entry));
+
+        moved.insert(pair<const char *, string_entry>(entry.str, newEntry));
+        newEntries.push_back(newEntry);
+    }
+
+    size_t i=0;
+    for (entry_map::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+        it->second = newEntries[i];
+        i++;
+    }
+    arena.Swap(newArena);
+}
+
+/* The symbols are picked from the strings that are long enough to be
+   compressed, counting strings shared between IDs once, and Compact() then
+   does the compressing. */
+void _strings_handle_int::Compress() {
+    vector< pair<const char *, size_t> > strings;
+    boost::unordered_set<const char *> seen;
+    for (entry_map::const_iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+        if (it->second.length >= minCompressedLength && seen.insert(it->second.str).second)
+            strings.push_back(pair<const char *, size_t>(it->second.str, it->second.length));
+    }
+
+    symbols.reset(new symbol_table());
+    symbols->Train(strings);
+    Compact();
+
+    if (mapping.is_open())
+        mapping.close();
+    mappedPath.clear();
+}
+
+void _strings_handle_int::Materialise() {
+    if (!mapping.is_open())
+        return;
+
+    Unpack();
+
+    //As in Compact(), copy everything before changing anything.
+    boost::unordered_map<const char *, const char *> moved;
+    vector<const char *> newStrs;
+    newStrs.reserve(data.size());
+
+    for (entry_map::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+        if (!IsMapped(it->second.str)) {
+            newStrs.push_back(it->second.str);
+            continue;
+        }
+
+        boost::unordered_map<const char *, const char *>::iterator movedIt = moved.find(it->second.str);
+        if (movedIt != moved.end())
+            newStrs.push_back(movedIt->second);
+        else {
+            const char * str = arena.Append(it->second.str, RawLength(it->second));
+            moved.insert(pair<const char *, const char *>(it->second.str, str));
+            newStrs.push_back(str);
+        }
+    }
+
+    size_t i=0;
+    for (entry_map::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+        it->second.str = newStrs[i];
+        i++;
+    }
+
+    mapping.close();
+    mappedPath.clear();
+    snapshotEntries = NULL;
+}
+
+namespace {
+    //Incremental saves fall back to a full save once the data block would be this many times its size when last fully written.
+    const uint64_t maxDataGrowth = 2;
+
+    //Incremental saves that rewrite more directory slots than this write the span between them at once.
+    const size_t maxSlotWrites = 64;
+
+    //A string to be written, used to write strings shared between IDs only once.
+    struct output_string {
+        const char * str;
+        size_t length;
+
+        bool operator == (const output_string& other) const {
+            return length == other.length && memcmp(str, other.str, length) == 0;
+        }
+    };
+
+    size_t hash_value(const output_string& value) {
+        return boost::hash_range(value.str, value.str + value.length);
     }
 }
 
 //Save file data to given path.
 void _strings_handle_int::Save(const std::string& path, const std::string& encoding) {
-    //Save everything in memory to the file.
-    string directory;
-    string strData;
-    boost::unordered_map<string, uint32_t> hashmap;
     bool isDotStrings;
 
     //Check extension.
@@ -174,51 +1206,407 @@ void _strings_handle_int::Save(const std::string& path, const std::string& encod
     else
         throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "File passed does not have a valid extension.");
 
-    //Output to buffers.
-    for (boost::unordered_map<uint32_t, string>::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+    //Overwriting the mapped file would invalidate the views, so copy them out first.
+    if (!mappedPath.empty() && fs::exists(path) && fs::equivalent(path, mappedPath))
+        Materialise();
 
-        /* Search for this pair's string in the hashset.
-            If present, use the offset in the hashmap for the directory entry's offset,
-            and don't add the string again.
-            Otherwise, add as normal. */
+    /* First work out where everything goes. Strings that are already in the
+       output encoding are written from where they are; anything that has to
+       be converted, or that is only in the decode cache (which the next
+       lookup may evict from), is kept in a temporary arena until written. */
+    const bool isUTF8 = boost::iequals("UTF-8", encoding);
+    const size_t prefixSize = isDotStrings ? 0 : sizeof(uint32_t);
+    string_arena encoded;
+    vector<uint32_t> directory;
+    vector<output_string> strings;
+    boost::unordered_map<output_string, uint32_t> offsets;
+    uint64_t dataSize = 0;
 
-        boost::unordered_map<string, uint32_t>::iterator searchIt = hashmap.find(it->second);
-        if (searchIt != hashmap.end()) {
-            //Write directory data to its buffer.
-            directory   += string((char*)&(it->first), sizeof(uint32_t))
-                        +  string((char*)&(searchIt->second), sizeof(uint32_t));
-        } else {
-            uint32_t len = strData.length();
+    //Time spent converting strings is counted as transcoding, and the rest of laying them out as dedup.
+    const uint64_t layoutStart = Ticks();
+    uint64_t transcodeTicks = 0;
+    uint64_t dedupHits = 0;
 
-            //Write directory data to its buffer.
-            directory   += string((char*)&(it->first), sizeof(uint32_t))
-                        +  string((char*)&len, sizeof(uint32_t));
+    directory.reserve(2 * Size());
+    offsets.rehash(Size());
+    for (entry_walker walker(*this); !walker.AtEnd(); walker.Next()) {
+        output_string out;
+        out.str = Resolve(walker.Id(), walker.Entry(), out.length);
+        if (!isUTF8) {
+            const uint64_t start = Ticks();
+            const string str = FromUTF8(string(out.str, out.length), encoding);
+            out.str = encoded.Append(str.data(), str.length());
+            out.length = str.length();
+            transcodeTicks += Ticks() - start;
+        } else if (walker.Entry().IsCached())
+            out.str = encoded.Append(out.str, out.length);
 
-            //Write string data to its buffer, and increment the dataSize.
-            string str = it->second + '\0';
-            if (!isDotStrings) {
-                uint32_t size = str.length();
-                str = string((char*)&size, sizeof(uint32_t)) + str;
-            }
-            strData += FromUTF8(str, encoding);
+        pair<boost::unordered_map<output_string, uint32_t>::iterator, bool> result = offsets.insert(pair<output_string, uint32_t>(out, uint32_t(dataSize)));
+        if (result.second) {
+            strings.push_back(out);
+            dataSize += prefixSize + out.length + 1;
+            if (dataSize > numeric_limits<uint32_t>::max())
+                throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "The strings are too large to be written to \"" + path + "\".");
+        } else
+            dedupHits++;
 
-            //Add to hashset to prevent it being written again.
-            hashmap.insert(pair<string, uint32_t>(it->second, len));
-        }
+        directory.push_back(walker.Id());
+        directory.push_back(result.first->second);
+    }
+
+    stats.Add(STAT_TRANSCODE_TIME, transcodeTicks);
+    stats.Add(STAT_DEDUP_TIME, Ticks() - layoutStart - transcodeTicks);
+    stats.Add(STAT_DEDUP_HITS, dedupHits);
+
+    //Now lay out the whole file in one buffer.
+    const uint32_t count = Size();
+    const size_t directorySize = directory.size() * sizeof(uint32_t);
+    vector<char> buffer(2 * sizeof(uint32_t) + directorySize + dataSize);
+    char * pos = &buffer[0];
 
+    const uint32_t dataSize32 = dataSize;
+    memcpy(pos, &count, sizeof(uint32_t));
+    memcpy(pos + sizeof(uint32_t), &dataSize32, sizeof(uint32_t));
+    pos += 2 * sizeof(uint32_t);
+    if (directorySize > 0)
+        memcpy(pos, &directory[0], directorySize);
+    pos += directorySize;
 
+    for (vector<output_string>::const_iterator it=strings.begin(), endIt=strings.end(); it != endIt; ++it) {
+        //The length prefix includes the null terminator.
+        if (!isDotStrings) {
+            const uint32_t size = it->length + 1;
+            memcpy(pos, &size, sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+        }
+        memcpy(pos, it->str, it->length);
+        pos += it->length;
+        *pos = '\0';
+        pos++;
     }
-    uint32_t count = data.size();
-    uint32_t dataSize = strData.length();
 
     //Now write out everything.
-    libstrings::ofstream out(fs::path(path), ios::binary | ios::trunc);
-    if (!out.good())
+    try {
+        stat_timer timer(stats, STAT_WRITE_TIME);
+        boost::iostreams::file_descriptor_sink out(fs::path(path), ios::binary | ios::trunc);
+        if (out.write(&buffer[0], buffer.size()) != streamsize(buffer.size()))
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+        out.close();
+        stats.Add(STAT_BYTES_WRITTEN, buffer.size());
+    } catch (ios_base::failure& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+    }
+
+    SetSource(path, encoding, count, dataSize);
+}
+
+/* Appends the dirty strings to the end of the file and points their
+   directory slots at them, leaving everything else as it is. The strings
+   they replace are left behind as unreferenced strings, so once the data
+   block has grown too much, a full save is done to get rid of them. */
+bool _strings_handle_int::SaveIncremental(const std::string& path, const std::string& encoding) {
+    //The directory must stay the same size, or the data block would move.
+    if (allDirty || sourcePath.empty() || Size() != sourceCount)
+        return false;
+
+    //The strings already in the file must be in the encoding the new ones are written in.
+    if (!boost::iequals(encoding, sourceEncoding))
+        return false;
+
+    //The file must be the one last read or written, and must not have changed since.
+    try {
+        if (!fs::exists(path) || !fs::equivalent(path, sourcePath) || fs::file_size(path) != sourceSize || fs::last_write_time(path) != sourceTime)
+            return false;
+    } catch (fs::filesystem_error&) {
+        return false;
+    }
+
+    if (dirty.empty())
+        return true;
+
+    const bool isDotStrings = boost::iequals(fs::path(path).extension().string(), ".strings");
+    const bool isUTF8 = boost::iequals("UTF-8", encoding);
+    const size_t prefixSize = isDotStrings ? 0 : sizeof(uint32_t);
+    const uint64_t startOfData = sizeof(uint32_t) * 2 * (uint64_t(sourceCount) + 1);
+    const uint64_t oldDataSize = sourceSize - startOfData;
+
+    try {
+        boost::iostreams::file_descriptor file(fs::path(path), ios::in | ios::out | ios::binary);
+
+        //Read the header and directory, then find the slots of the dirty IDs.
+        vector<uint32_t> directory(2 * (size_t(sourceCount) + 1));
+        const streamsize directorySize = directory.size() * sizeof(uint32_t);
+        if (file.read(reinterpret_cast<char *>(&directory[0]), directorySize) != directorySize || directory[0] != sourceCount)
+            return false;
+        stats.Add(STAT_BYTES_READ, directorySize);
+
+        //Slots of replaced IDs are rewritten, and slots of removed IDs are given to added IDs.
+        vector<uint32_t> slots;
+        vector<uint32_t> freeSlots;
+        boost::unordered_set<uint32_t> inFile;
+        for (uint32_t i=1; i <= sourceCount; i++) {
+            const uint32_t id = directory[2 * i];
+            if (dirty.find(id) == dirty.end())
+                continue;
+
+            inFile.insert(id);
+            if (data.find(id) != data.end())
+                slots.push_back(i);
+            else
+                freeSlots.push_back(i);
+        }
+
+        vector<uint32_t> added;
+        for (boost::unordered_set<uint32_t>::const_iterator it=dirty.begin(), endIt=dirty.end(); it != endIt; ++it) {
+            if (inFile.find(*it) == inFile.end() && data.find(*it) != data.end())
+                added.push_back(*it);
+        }
+        if (added.size() != freeSlots.size())
+            return false;
+
+        for (size_t i=0; i < added.size(); i++) {
+            directory[2 * freeSlots[i]] = added[i];
+            slots.push_back(freeSlots[i]);
+        }
+        sort(slots.begin(), slots.end());
+
+        //Lay out the strings to append, writing strings shared between IDs once, as Save() does.
+        string_arena encoded;
+        string appended;
+        boost::unordered_map<output_string, uint32_t> offsets;
+        const uint64_t layoutStart = Ticks();
+        uint64_t transcodeTicks = 0;
+        uint64_t dedupHits = 0;
+        for (size_t i=0; i < slots.size(); i++) {
+            const uint32_t id = directory[2 * slots[i]];
+            entry_map::iterator it = data.find(id);
+
+            output_string out;
+            out.str = Resolve(id, it->second, out.length);
+            if (!isUTF8) {
+                const uint64_t start = Ticks();
+                const string str = FromUTF8(string(out.str, out.length), encoding);
+                out.str = encoded.Append(str.data(), str.length());
+                out.length = str.length();
+                transcodeTicks += Ticks() - start;
+            } else if (it->second.IsCached())
+                out.str = encoded.Append(out.str, out.length);
+
+            const uint64_t offset = oldDataSize + appended.length();
+            pair<boost::unordered_map<output_string, uint32_t>::iterator, bool> result = offsets.insert(pair<output_string, uint32_t>(out, uint32_t(offset)));
+            if (result.second) {
+                if (offset + prefixSize + out.length + 1 > numeric_limits<uint32_t>::max())
+                    return false;
+
+                //The length prefix includes the null terminator.
+                if (!isDotStrings) {
+                    const uint32_t size = out.length + 1;
+                    appended.append(reinterpret_cast<const char *>(&size), sizeof(uint32_t));
+                }
+                appended.append(out.str, out.length);
+                appended += '\0';
+            } else
+                dedupHits++;
+            directory[2 * slots[i] + 1] = result.first->second;
+        }
+        stats.Add(STAT_TRANSCODE_TIME, transcodeTicks);
+        stats.Add(STAT_DEDUP_TIME, Ticks() - layoutStart - transcodeTicks);
+        stats.Add(STAT_DEDUP_HITS, dedupHits);
+
+        const uint64_t newDataSize = oldDataSize + appended.length();
+        if (newDataSize > maxDataGrowth * compactDataSize)
+            return false;
+
+        //Overwriting the mapped file would change the strings it holds, so copy them out first.
+        if (!mappedPath.empty() && fs::equivalent(path, mappedPath))
+            Materialise();
+
+        /* Append the strings before pointing anything at them, so that the
+           file is readable at every step. The directory slots are written
+           one by one if there are few, or together if there are many. */
+        stat_timer timer(stats, STAT_WRITE_TIME);
+        if (file.seek(sourceSize, ios_base::beg) != streamoff(sourceSize)
+            || (!appended.empty() && file.write(appended.data(), appended.length()) != streamsize(appended.length())))
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+
+        if (slots.size() > maxSlotWrites) {
+            const streamsize size = (slots.back() - slots.front() + 1) * 2 * sizeof(uint32_t);
+            file.seek(slots.front() * 2 * sizeof(uint32_t), ios_base::beg);
+            if (file.write(reinterpret_cast<const char *>(&directory[2 * slots.front()]), size) != size)
+                throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+            stats.Add(STAT_BYTES_WRITTEN, size);
+        } else {
+            for (size_t i=0; i < slots.size(); i++) {
+                file.seek(slots[i] * 2 * sizeof(uint32_t), ios_base::beg);
+                if (file.write(reinterpret_cast<const char *>(&directory[2 * slots[i]]), 2 * sizeof(uint32_t)) != streamsize(2 * sizeof(uint32_t)))
+                    throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+            }
+            stats.Add(STAT_BYTES_WRITTEN, slots.size() * 2 * sizeof(uint32_t));
+        }
+
+        const uint32_t dataSize32 = newDataSize;
+        file.seek(sizeof(uint32_t), ios_base::beg);
+        if (file.write(reinterpret_cast<const char *>(&dataSize32), sizeof(uint32_t)) != streamsize(sizeof(uint32_t)))
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+        file.close();
+        stats.Add(STAT_BYTES_WRITTEN, appended.length() + sizeof(uint32_t));
+
+        sourceSize = startOfData + newDataSize;
+        sourceTime = fs::last_write_time(path);
+    } catch (ios_base::failure& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+    } catch (fs::filesystem_error& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, e.what());
+    }
+
+    dirty.clear();
+    return true;
+}
+
+/* A snapshot stands in for its strings file for as long as the file's
+   size, time and directory are unchanged, so the handle must hold what
+   that file does. The snapshot is written to a
+   temporary file that then replaces any existing one, so that a snapshot
+   being read by another process is never seen half-written. */
+void _strings_handle_int::SaveSnapshot(const std::string& path) {
+    if (sourcePath.empty() || allDirty || !dirty.empty())
+        throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "The handle has been changed since it was opened or saved.");
+
+    snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.version = snapshotVersion;
+    header.count = Size();
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.sourceDataSize = compactDataSize;
+    header.sourceCount = sourceCount;
+    if (sourceEncoding.length() < sizeof(header.sourceEncoding))
+        memcpy(header.sourceEncoding, sourceEncoding.data(), sourceEncoding.length());
+    try {
+        if (!fs::exists(sourcePath) || fs::file_size(sourcePath) != sourceSize || fs::last_write_time(sourcePath) != sourceTime)
+            throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "\"" + sourcePath + "\" has changed since it was read or saved.");
+    } catch (fs::filesystem_error& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what());
+    }
+    header.sourceHash = HashSourceDirectory(sourcePath, sourceCount);
+
+    /* Lay out the strings, keeping strings shared between IDs shared, as
+       Compact() does. Strings in the decode cache are never shared. */
+    vector<snapshot_entry> entries(Size());
+    string strings;
+    {
+        boost::unique_lock<boost::mutex> lock(decodeMutex, boost::defer_lock);
+        if (DecodesOnAccess())
+            lock.lock();
+
+        boost::unordered_map<const char *, uint64_t> offsets;
+        size_t i=0;
+        for (entry_walker walker(*this, true); !walker.AtEnd(); walker.Next(), i++) {
+            string_entry& entry = walker.Entry();
+            size_t length;
+            const char * str = Resolve(walker.Id(), entry, length);
+
+            entries[i].id = walker.Id();
+            entries[i].length = length;
+            entries[i].offset = strings.length();
+            entries[i].hash = HashBytes(str, length);
+            if (!entry.IsCached()) {
+                pair<boost::unordered_map<const char *, uint64_t>::iterator, bool> result = offsets.insert(pair<const char *, uint64_t>(str, strings.length()));
+                entries[i].offset = result.first->second;
+                if (!result.second)
+                    continue;
+            }
+            strings.append(str, length);
+            strings += '\0';
+        }
+    }
+    header.stringsSize = strings.length();
+
+    const fs::path outPath(path);
+    fs::path tempPath;
+    try {
+        tempPath = outPath.parent_path() / fs::unique_path(outPath.filename().string() + ".%%%%-%%%%-%%%%.tmp");
+
+        stat_timer timer(stats, STAT_WRITE_TIME);
+        boost::iostreams::file_descriptor_sink out(tempPath, ios::binary | ios::trunc);
+        const streamsize entriesSize = entries.size() * sizeof(snapshot_entry);
+        if (out.write(reinterpret_cast<const char *>(&header), sizeof(header)) != streamsize(sizeof(header))
+            || (entriesSize > 0 && out.write(reinterpret_cast<const char *>(&entries[0]), entriesSize) != entriesSize)
+            || (!strings.empty() && out.write(strings.data(), strings.length()) != streamsize(strings.length())))
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+        out.close();
+        stats.Add(STAT_BYTES_WRITTEN, sizeof(header) + entriesSize + strings.length());
+
+        fs::rename(tempPath, outPath);
+    } catch (exception& e) {
+        boost::system::error_code ec;
+        if (!tempPath.empty())
+            fs::remove(tempPath, ec);
+
+        if (dynamic_cast<error *>(&e) != NULL)
+            throw;
         throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
-    out.write((char*)&count, sizeof(uint32_t));
-    out.write((char*)&dataSize, sizeof(uint32_t));
-    out.write((char*)directory.data(), directory.length());
-    out.write((char*)strData.data(), strData.length());
+    }
+}
+
+void _strings_handle_int::SetSource(const std::string& path, const std::string& encoding, const uint32_t count, const uint64_t dataSize) {
+    //If the file can't be checked later, it can't be saved to incrementally.
+    boost::system::error_code sizeError, timeError;
+    sourceSize = fs::file_size(path, sizeError);
+    sourceTime = fs::last_write_time(path, timeError);
+    sourcePath = (sizeError || timeError) ? string() : path;
+
+    sourceEncoding = encoding;
+    sourceCount = count;
+    compactDataSize = dataSize;
+    dirty.clear();
+    allDirty = false;
+}
+
+entry_walker::entry_walker(_strings_handle_int& sh, const bool sorted) :
+    sh(sh),
+    sorted(sorted && !sh.FromSnapshot()),
+    pos(0),
+    it(sh.data.begin()) {
+
+    if (this->sorted) {
+        entries.reserve(sh.data.size());
+        for (entry_map::iterator mapIt=sh.data.begin(), endIt=sh.data.end(); mapIt != endIt; ++mapIt)
+            entries.push_back(pair<uint32_t, string_entry *>(mapIt->first, &mapIt->second));
+        sort(entries.begin(), entries.end());
+    }
+}
+
+bool entry_walker::AtEnd() const {
+    if (sh.FromSnapshot())
+        return pos == sh.snapshotCount;
+    else if (sorted)
+        return pos == entries.size();
+    return it == sh.data.end();
+}
+
+void entry_walker::Next() {
+    if (sh.FromSnapshot() || sorted)
+        pos++;
+    else
+        ++it;
+}
+
+uint32_t entry_walker::Id() const {
+    if (sh.FromSnapshot())
+        return sh.snapshotEntries[pos].id;
+    else if (sorted)
+        return entries[pos].first;
+    return it->first;
+}
 
-    out.close();
+string_entry& entry_walker::Entry() {
+    if (sh.FromSnapshot()) {
+        copy.str = sh.snapshotStrings + sh.snapshotEntries[pos].offset;
+        copy.length = sh.snapshotEntries[pos].length;
+        return copy;
+    } else if (sorted)
+        return *entries[pos].second;
+    return it->second;
 }
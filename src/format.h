@@ -26,11 +26,107 @@
 
 #include "libstrings.h"
 #include "helpers.h"
+#include "arena.h"
+#include "cache.h"
+#include "compress.h"
+#include "simd.h"
+#include "search.h"
+#include "idindex.h"
+#include "snapshot.h"
+#include "stats.h"
 #include <stdint.h>
+#include <ctime>
 #include <string>
 #include <boost/unordered_set.hpp>
 #include <boost/unordered_map.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <map>
+#include <vector>
+
+namespace libstrings {
+    //Gets where the data block of a file's contents starts, checking that the file isn't truncated.
+    uint64_t FindDataBlock(const char * fileContent, const size_t fileSize, const std::string& path);
+
+    //Gets the string at the given offset in the data block, or NULL if it's outside the file.
+    const char * StringAt(const char * fileContent, const size_t fileSize, const uint64_t startOfData, const uint32_t offset, const bool isDotStrings);
+}
+
+/* A string's UTF-8 bytes, which are either in the handle's arena (which may
+   hold the whole file as read into memory) or in the mapped file. The length
+   excludes the null terminator that always follows. Lazily-opened handles
+   don't look at a string until it is first accessed, and serve strings that
+   need transcoding from the decode cache. Compressed strings are also served
+   from the cache, and str points to their compressed_string header. */
+struct string_entry {
+    const char * str;
+    uint32_t length;
+
+    static const uint32_t undecoded = 0xFFFFFFFF;
+    static const uint32_t transcoded = 0xFFFFFFFE;
+    static const uint32_t compressed = 0xFFFFFFFD;
+
+    bool IsCached() const { return length == transcoded || length == compressed; }  //Whether Resolve() outputs the string from the decode cache.
+};
+
+//Maps string IDs to entries. Nodes come from a pool, and don't move once inserted.
+typedef boost::unordered_map<uint32_t, string_entry, boost::hash<uint32_t>, std::equal_to<uint32_t>,
+    libstrings::pool_allocator< std::pair<const uint32_t, string_entry> > > entry_map;
+
+//Precedes a compressed string's codes in the arena.
+struct compressed_string {
+    uint32_t size;      //Of the codes.
+    uint32_t length;    //Of the decompressed string.
+};
+
+/* Memory for the data output by a handle's reading functions. Each thread
+   that reads from a handle gets its own, so that one thread's output isn't
+   freed by another thread's call. */
+struct export_slots {
+    export_slots();
+    ~export_slots();
+
+    st_string_data * stringDataArr;
+    char ** stringArr;
+    char * string;
+    std::vector<st_string_view> stringViews;
+
+    //Output by st_get_strings_by_ids().
+    std::vector<st_string_view> batchViews;
+    std::vector<uint8_t> batchFound;
+
+    //Output by st_filter_ids().
+    std::vector<uint32_t> filterIds;
+
+    //Output by st_search().
+    std::vector<uint32_t> searchIds;
+
+    //Output by st_get_string_range().
+    std::vector<st_string_view> rangeViews;
+
+    //Output by st_diff().
+    std::vector<uint32_t> diffAdded;
+    std::vector<uint32_t> diffRemoved;
+    std::vector<uint32_t> diffChanged;
+
+    //Output by st_apply_edits().
+    std::vector<uint8_t> editStatuses;
+
+    size_t stringDataArrSize;
+    size_t stringArrSize;
+
+    void FreeStringDataArr();
+    void FreeStringArr();
+    void FreeString();
+private:
+    //Not copyable.
+    export_slots(const export_slots&);
+    export_slots& operator = (const export_slots&);
+};
 
 /* See here for format details: http://www.uesp.net/wiki/Tes5Mod:String_Table_File_Format
    Files read may be in UTF-8, Windows-1252 or Windows-1251.
@@ -38,26 +134,156 @@
    Store strings in UTF-8. */
 struct _strings_handle_int {
 public:
-    _strings_handle_int(const std::string& path, const std::string& fallbackEncoding);
+    _strings_handle_int(const std::string& path, const std::string& fallbackEncoding, const unsigned int flags = 0);
+    _strings_handle_int(const libstrings::snapshot_file& snapshot, const std::string& path);  //path is the strings file the snapshot was saved from.
     ~_strings_handle_int();
 
     //File data.
-    boost::unordered_map<uint32_t, std::string> data;       //Internal data storage. uint32_t is the string id and std::string is the string itself.
+    entry_map data;                                         //Internal data storage. uint32_t is the string id.
+    libstrings::string_arena arena;                         //Holds all string bytes that aren't in the mapped file.
+
+    //The mapped file, if the handle was opened with LIBSTRINGS_OPEN_MAPPED.
+    boost::iostreams::mapped_file_source mapping;
+    std::string mappedPath;
 
-    //External data pointers.
-    st_string_data * extStringDataArr;
-    char ** extStringArr;
-    char * extString;
+    //Used to decode strings that haven't been accessed yet.
+    std::string fallbackEncoding;
+    libstrings::decode_cache cache;
 
-    //External data array sizes.
-    size_t extStringDataArrSize;
-    size_t extStringArrSize;
+    /* Reading functions hold the mutex shared, and functions that change the
+       handle hold it exclusively. Lazily-opened handles change entries and
+       the cache when strings are first read, and compressed handles change
+       the cache, so also serialise that. */
+    boost::shared_mutex mutex;
+    boost::mutex decodeMutex;
+    bool lazy;
+    bool DecodesOnAccess() const;  //Whether decodeMutex must be held to resolve strings.
+
+    //Trained on the handle's strings if it was opened with LIBSTRINGS_OPEN_COMPRESSED.
+    boost::scoped_ptr<libstrings::symbol_table> symbols;
+
+    //Built by the first search after the handle is opened or modified, which serialise building it.
+    boost::scoped_ptr<libstrings::search_index> searchIndex;
+    boost::mutex searchMutex;
+
+    /* Built by the first range query after the handle is opened or modified,
+       which serialise building it. Lookups use it once it's built, without
+       locking, so it's published through idIndexBuilt. */
+    boost::scoped_ptr<libstrings::id_index> idIndex;
+    boost::atomic<const libstrings::id_index *> idIndexBuilt;
+    boost::mutex idIndexMutex;
+
+    /* Each ID and the HashBytes() of its string, in ascending order of ID.
+       Built by the first diff after the handle is opened or modified, which
+       serialise building it. Handles opened from a snapshot take the hashes
+       saved in it, until they're modified or unmapped. */
+    boost::scoped_ptr< std::vector< std::pair<uint32_t, uint64_t> > > contentHashes;
+    boost::mutex contentHashesMutex;
+    const libstrings::snapshot_entry * snapshotEntries;
+
+    /* Handles opened from a snapshot find their strings in its mapped
+       directory, which is sorted by ID, and leave data empty until they're
+       first modified, when Unpack() fills it. */
+    uint32_t snapshotCount;
+    const char * snapshotStrings;  //NULL once unpacked.
+    bool FromSnapshot() const;
+    size_t Size() const;  //The number of strings.
+    void Unpack();  //Does nothing if the handle isn't serving a snapshot. Must be locked for writing.
+
+    //What the handle has done, which is also added to the library's totals.
+    libstrings::stats stats;
+    libstrings::decode_stats decodeCounts;  //Counted by Resolve() and not yet added to stats.
+    void GetStats(st_stats& out);  //Must be locked for reading.
+
+    //External data, per thread.
+    boost::unordered_map<boost::thread::id, export_slots*> exports;
+    boost::mutex exportsMutex;
+    export_slots& Exports();  //Gets the calling thread's.
 
     //All the unreferenced strings in the file.
     boost::unordered_set<std::string> unrefStrings;
 
+    //Lookup and modification.
+    string_entry * Find(const uint32_t id, string_entry& scratch);  //Returns NULL if there's no such ID. A snapshot's entries are copied into scratch. Must be locked for reading.
+    const libstrings::id_index * IdIndex() const;  //Returns NULL if the ID index isn't built. Must be locked for reading.
+    const char * Resolve(const uint32_t id, string_entry& entry, size_t& length);  //Decodes the string if necessary. Not thread-safe.
+    const char * Pin(const uint32_t id, string_entry& entry, size_t& length);  //As Resolve(), but the string stays valid until the handle is modified.
+    char * Copy(const uint32_t id, string_entry& entry);  //As Resolve(), but outputs a copy made using new[].
+    void Set(const uint32_t id, const char * str, const size_t length);
+    void SetAll(const st_string_data * strings, const size_t numStrings);
+    bool Erase(const uint32_t id);
+    bool ApplyEdits(const st_string_edit * edits, const size_t numEdits, std::vector<uint8_t>& statuses);  //Returns false if any edit is invalid.
+    void Overlay(_strings_handle_int& src, const st_overlay_selector& selector, const bool addMissing);  //src must be locked for reading.
+    void Filter(const libstrings::pattern_matcher& matcher, std::vector<uint32_t>& ids);  //Outputs the IDs of the strings that match. Must be locked for reading.
+    void BuildSearchIndex();  //Does nothing if the index is already built. Must be locked for reading.
+    void Search(const char * query, const size_t length, const bool ignoreCase, std::vector<uint32_t>& ids);  //Outputs IDs in ascending order. Must be locked for reading.
+    const libstrings::id_index * BuildIdIndex();  //Returns NULL if serving a snapshot, whose entries need no index. Must be locked for reading.
+    void GetRange(const uint32_t lo, const uint32_t hi, std::vector<st_string_view>& views);  //Outputs views in ascending order of ID. Must be locked for reading.
+    void BuildContentHashes();  //Does nothing if the hashes are already built. Must be locked for reading.
+    void Diff(_strings_handle_int& other, std::vector<uint32_t>& added, std::vector<uint32_t>& removed, std::vector<uint32_t>& changed);  //Outputs IDs in ascending order. Must be locked for reading, as must other.
+
+    //Copy all live strings into a new arena, freeing the space used by replaced strings.
+    void Compact();
+
+    //Train the symbol table and compress the long strings into a new arena, unmapping the file.
+    void Compress();
+
+    //Copy all strings in the mapped file into the arena and unmap the file.
+    void Materialise();
+
     //Save file data to given path.
     void Save(const std::string& path, const std::string& encoding);
+
+    //Write only the strings changed since the file at path was last read or written. Returns false if a full save is needed.
+    bool SaveIncremental(const std::string& path, const std::string& encoding);
+
+    //Save the strings and where they were read from to a snapshot at path.
+    void SaveSnapshot(const std::string& path);
+private:
+    /* The file the handle was last read from or written to, what it looked
+       like then, and which IDs have been added, replaced or removed since.
+       IDs may be marked dirty without having changed. */
+    std::string sourcePath;
+    uint64_t sourceSize;
+    std::time_t sourceTime;
+    std::string sourceEncoding; //Encoding the file was read or written in.
+    uint32_t sourceCount;       //Number of directory entries.
+    uint64_t compactDataSize;   //Size of the data block when last fully written.
+    boost::unordered_set<uint32_t> dirty;
+    bool allDirty;
+
+    void SetSource(const std::string& path, const std::string& encoding, const uint32_t count, const uint64_t dataSize);
+    void Invalidate();  //Drops the indexes and hashes, which no longer match the strings.
+
+    //Adds or replaces the changed entries, whose strings are already in the arena, and removes the removed IDs.
+    void Commit(const std::vector< std::pair<uint32_t, string_entry> >& changed, const std::vector<uint32_t>& removed);
+
+    void Parse(const char * fileContent, const size_t fileSize, const bool isDotStrings, const unsigned int flags, const std::string& path);
+    bool IsMapped(const char * str) const;
+    size_t RawLength(const string_entry& entry) const;
+    std::string Decompress(const string_entry& entry) const;
+    const char * AppendCompressed(libstrings::string_arena& target, const char * str, const size_t length, std::string& codes) const;  //Returns NULL if compressing doesn't save space.
+};
+
+/* Walks a handle's entries, in ascending order of ID if sorted is true.
+   While a handle serves a snapshot, its entries are walked in the
+   snapshot's order, which is sorted, and each is given as a copy: the
+   strings are already decoded, so Resolve() and Pin() leave it unchanged. */
+class entry_walker {
+public:
+    entry_walker(_strings_handle_int& sh, const bool sorted = false);
+
+    bool AtEnd() const;
+    void Next();
+    uint32_t Id() const;
+    string_entry& Entry();
+private:
+    _strings_handle_int& sh;
+    const bool sorted;
+    size_t pos;  //In the snapshot's entries or in entries.
+    entry_map::iterator it;
+    std::vector< std::pair<uint32_t, string_entry *> > entries;
+    string_entry copy;
 };
 
 #endif
@@ -24,11 +24,11 @@
 #include "helpers.h"
 #include "libstrings.h"
 #include "error.h"
+#include "simd.h"
+#include "codepages.h"
 
 #include <cstring>
 
-#include <source/utf8.h>
-
 #include <boost/locale.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -42,25 +42,103 @@ namespace libstrings {
         return strcpy(p, str.c_str());
     }
 
+    char * ToNewCString(const char * str, const size_t length) {
+        char * p = new char[length + 1];
+        memcpy(p, str, length);
+        p[length] = '\0';
+        return p;
+    }
+
     std::string ToUTF8(const std::string& str, const std::string& encoding) {
-        if (utf8::is_valid(str.begin(), str.end()) || boost::iequals("UTF-8", encoding))
+        if (boost::iequals("UTF-8", encoding) || IsValidUTF8(str.data(), str.length()))
             return str;
 
+        return TranscodeToUTF8(str.data(), str.length(), encoding);
+    }
+
+    std::string TranscodeToUTF8(const char * str, const size_t length, const std::string& encoding) {
+        //Use the built-in converters where possible, as they're much faster.
+        const code_page * codePage = FindCodePage(encoding);
+        if (codePage != NULL) {
+            string out;
+            size_t errorPos;
+            if (!DecodeCodePage(*codePage, str, length, out, errorPos))
+                throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + string(str, length) + "\" cannot be encoded in " + encoding + ".");
+            return out;
+        }
+
         try {
-            return boost::locale::conv::to_utf<char>(str, encoding, boost::locale::conv::stop);
+            return boost::locale::conv::to_utf<char>(str, str + length, encoding, boost::locale::conv::stop);
         } catch (boost::locale::conv::conversion_error& e) {
-            throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + str + "\" cannot be encoded in " + encoding + ".");
+            throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + string(str, length) + "\" cannot be encoded in " + encoding + ".");
         }
     }
 
     std::string FromUTF8(const std::string& str, const std::string& encoding) {
         if (boost::iequals("UTF-8", encoding))
             return str;
+
+        const code_page * codePage = FindCodePage(encoding);
+        if (codePage != NULL) {
+            string out;
+            size_t errorPos;
+            if (!EncodeCodePage(*codePage, str.data(), str.length(), out, errorPos))
+                throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + str + "\" cannot be encoded in " + encoding + ".");
+            return out;
+        }
+
         try {
             return boost::locale::conv::from_utf<char>(str, encoding, boost::locale::conv::stop);
         } catch (boost::locale::conv::conversion_error& e) {
-            cout << "\n\n\n\n" << e.what() << "\n\n\n\n";
             throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + str + "\" cannot be encoded in " + encoding + ".");
         }
     }
+
+    // MurmurHash64A, by Austin Appleby, which is in the public domain.
+    uint64_t HashBytes(const char * str, const size_t length) {
+        const uint64_t m = 0xC6A4A7935BD1E995ULL;
+        const int r = 47;
+        uint64_t h = 0x8445D61A4E774912ULL ^ (length * m);
+
+        const char * end = str + (length & ~size_t(7));
+        for (; str != end; str += 8) {
+            uint64_t k;
+            memcpy(&k, str, sizeof(k));
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+
+        const unsigned char * tail = reinterpret_cast<const unsigned char *>(str);
+        switch (length & 7) {
+        case 7:
+            h ^= uint64_t(tail[6]) << 48;
+            //fallthrough
+        case 6:
+            h ^= uint64_t(tail[5]) << 40;
+            //fallthrough
+        case 5:
+            h ^= uint64_t(tail[4]) << 32;
+            //fallthrough
+        case 4:
+            h ^= uint64_t(tail[3]) << 24;
+            //fallthrough
+        case 3:
+            h ^= uint64_t(tail[2]) << 16;
+            //fallthrough
+        case 2:
+            h ^= uint64_t(tail[1]) << 8;
+            //fallthrough
+        case 1:
+            h ^= uint64_t(tail[0]);
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
 }
@@ -30,13 +30,19 @@
 namespace libstrings {
         // std::string to null-terminated uint8_t string converter.
         char * ToNewCString(const std::string& str);
+        char * ToNewCString(const char * str, const size_t length);
 
         // Encoding conversions. 'encoding' can be of the form "Windows-*".
         // For ToUTF8, 'encoding' is actually the fallback encoding, and the
         // function first checks if the string is already valid UTF-8 before
         // doing anything.
         std::string ToUTF8(const std::string& str, const std::string& encoding);
+        std::string TranscodeToUTF8(const char * str, const size_t length, const std::string& encoding);  // Doesn't check if str is already UTF-8.
         std::string FromUTF8(const std::string& str, const std::string& encoding);
+
+        // A 64-bit hash of the given bytes that is the same on every run and
+        // build, so it can be stored in files.
+        uint64_t HashBytes(const char * str, const size_t length);
 }
 
 #endif
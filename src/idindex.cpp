@@ -0,0 +1,158 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "idindex.h"
+#include "simd.h"
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+    //A cache line holds this many IDs, which are the descendants of a node four levels down.
+    const size_t prefetchStride = 16;
+
+    //IDs are looked up directly if there are at most this many possible IDs between the lowest and highest per ID.
+    const uint64_t maxSlotsPerId = 4;
+
+    //How far ahead slots are prefetched when finding many IDs.
+    const size_t lookahead = 8;
+
+    unsigned int CountTrailingZeros(const uint64_t x) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, x);
+        return index;
+#else
+        unsigned int count = 0;
+        while (((x >> count) & 1) == 0)
+            count++;
+        return count;
+#endif
+    }
+
+    //A search ends below a leaf, having gone left or right at every level. The last left turn was at the lower bound.
+    inline size_t LastLeftTurn(const uint64_t node) {
+        return node >> (CountTrailingZeros(~node) + 1);
+    }
+}
+
+namespace libstrings {
+    id_index::id_index() : lowestId(0) {}
+
+    void id_index::Add(const uint32_t id, string_entry * entry) {
+        sorted.push_back(pair<uint32_t, string_entry *>(id, entry));
+    }
+
+    //The tree is filled by an in-order walk, which visits the nodes in ascending order.
+    void id_index::Build() {
+        tree.assign(sorted.size() + 1, 0);
+        entries.assign(sorted.size() + 1, NULL);
+        Fill(0, 1);
+
+        if (!sorted.empty()) {
+            const uint64_t span = uint64_t(sorted.back().first) - sorted.front().first + 1;
+            if (span <= maxSlotsPerId * sorted.size()) {
+                lowestId = sorted.front().first;
+                slots.assign(span, 0);
+                for (size_t node=1; node < tree.size(); node++)
+                    slots[tree[node] - lowestId] = node;
+            }
+        }
+        vector< pair<uint32_t, string_entry *> >().swap(sorted);
+    }
+
+    size_t id_index::Fill(size_t next, const size_t node) {
+        if (node >= tree.size())
+            return next;
+
+        next = Fill(next, 2 * node);
+        tree[node] = sorted[next].first;
+        entries[node] = sorted[next].second;
+        return Fill(next + 1, 2 * node + 1);
+    }
+
+    uint32_t id_index::IdAt(const size_t node) const {
+        return tree[node];
+    }
+
+    string_entry * id_index::EntryAt(const size_t node) const {
+        return entries[node];
+    }
+
+    /* The search goes left or right at every level without branching. The
+       address prefetched is worked out as an integer, as it's past the end
+       of the tree for the last few levels, which prefetching ignores. */
+    size_t id_index::LowerBound(const uint32_t id) const {
+        const size_t size = tree.size() - 1;
+        const uint32_t * nodes = &tree[0];
+        const uintptr_t base = reinterpret_cast<uintptr_t>(nodes);
+        uint64_t node = 1;
+        while (node <= size) {
+            LIBSTRINGS_PREFETCH(reinterpret_cast<const char *>(base + node * prefetchStride * sizeof(uint32_t)));
+            node = 2 * node + (nodes[node] < id);
+        }
+        return LastLeftTurn(node);
+    }
+
+    //The next node in order is the leftmost in the right subtree, or else the first ancestor that the node is left of.
+    size_t id_index::Next(size_t node) const {
+        const size_t size = tree.size() - 1;
+        if (2 * node + 1 <= size) {
+            node = 2 * node + 1;
+            while (2 * node <= size)
+                node = 2 * node;
+            return node;
+        }
+        return LastLeftTurn(node);
+    }
+
+    bool id_index::IsDirect() const {
+        return !slots.empty();
+    }
+
+    string_entry * id_index::Find(const uint32_t id) const {
+        if (!slots.empty()) {
+            const uint32_t slot = id - lowestId;
+            return (id < lowestId || slot >= slots.size()) ? NULL : entries[slots[slot]];
+        }
+
+        const size_t node = LowerBound(id);
+        if (node == 0 || tree[node] != id)
+            return NULL;
+        return entries[node];
+    }
+
+    //Slots are prefetched a few IDs ahead, so that the misses of several lookups overlap.
+    void id_index::Find(const uint32_t * ids, const size_t numIds, string_entry ** found) const {
+        for (size_t i=0; i < numIds; i++) {
+            if (!slots.empty() && i + lookahead < numIds && ids[i + lookahead] >= lowestId && ids[i + lookahead] - lowestId < slots.size())
+                LIBSTRINGS_PREFETCH(&slots[ids[i + lookahead] - lowestId]);
+            found[i] = Find(ids[i]);
+        }
+    }
+}
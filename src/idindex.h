@@ -0,0 +1,84 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_IDINDEX_H__
+#define __LIBSTRINGS_IDINDEX_H__
+
+#include <stdint.h>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+struct string_entry;
+
+namespace libstrings {
+
+    /* The IDs of a handle's strings with pointers to their entries, which
+       stay where they are in the handle's map until the string is removed.
+       The IDs are held in Eytzinger order, i.e. as an implicit binary
+       search tree laid out level by level, so that the first few levels of
+       every search share a handful of cache lines, and the nodes a search
+       will visit a few levels further down are next to each other and can
+       be prefetched. Nodes are numbered from 1, and 0 means no node. */
+    class id_index {
+    public:
+        id_index();
+
+        //IDs must be added in ascending order, and before Build() is called.
+        void Add(const uint32_t id, string_entry * entry);
+        void Build();
+
+        uint32_t IdAt(const size_t node) const;
+        string_entry * EntryAt(const size_t node) const;
+
+        //Gets the node with the lowest ID not less than the given one.
+        size_t LowerBound(const uint32_t id) const;
+
+        //Gets the node with the next highest ID.
+        size_t Next(size_t node) const;
+
+        //Gets the entry with the given ID, or NULL if there is none.
+        string_entry * Find(const uint32_t id) const;
+
+        //Whether IDs are looked up directly, which is quicker than a hash table, rather than by searching the tree, which isn't.
+        bool IsDirect() const;
+
+        //Gets the entries for many IDs, which is quicker than finding them one by one.
+        void Find(const uint32_t * ids, const size_t numIds, string_entry ** entries) const;
+    private:
+        std::vector<uint32_t> tree;
+        std::vector<string_entry *> entries;
+
+        /* If the IDs are dense enough, the node for each ID from the lowest
+           to the highest, so that finding an ID is a single lookup. */
+        uint32_t lowestId;
+        std::vector<uint32_t> slots;
+
+        //While building, the IDs and entries in ascending order.
+        std::vector< std::pair<uint32_t, string_entry *> > sorted;
+
+        size_t Fill(size_t next, const size_t node);  //Returns the next position in sorted to place.
+    };
+}
+
+#endif
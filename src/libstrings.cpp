@@ -24,9 +24,16 @@
 #include "libstrings.h"
 #include "error.h"
 #include "format.h"
+#include "directory.h"
+#include "writer.h"
+#include "cursor.h"
+#include "simd.h"
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/detail/utf8_codecvt_facet.hpp>
 #include <boost/unordered_set.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/thread/tss.hpp>
 #include <locale>
 #include <sstream>
 #include <vector>
@@ -42,10 +49,14 @@ const unsigned int LIBSTRINGS_VERSION_MAJOR = 2;
 const unsigned int LIBSTRINGS_VERSION_MINOR = 0;
 const unsigned int LIBSTRINGS_VERSION_PATCH = 0;
 
-const char * extErrorString = NULL;
+//Each thread has its own last error message.
+boost::thread_specific_ptr<std::string> extErrorString;
 
 unsigned int c_error(const error& e) {
-    extErrorString = ToNewCString(e.what());
+    if (extErrorString.get() == NULL)
+        extErrorString.reset(new std::string(e.what()));
+    else
+        *extErrorString = e.what();
     return e.code();
 }
 
@@ -67,6 +78,37 @@ const unsigned int LIBSTRINGS_ERROR_FILE_WRITE_FAIL     = 4;
 const unsigned int LIBSTRINGS_ERROR_BAD_STRING          = 5;
 const unsigned int LIBSTRINGS_RETURN_MAX                = LIBSTRINGS_ERROR_BAD_STRING;
 
+/* The following are the flags that st_open_ex() accepts. */
+const unsigned int LIBSTRINGS_OPEN_MAPPED               = 1;
+const unsigned int LIBSTRINGS_OPEN_LAZY                 = 2;
+const unsigned int LIBSTRINGS_OPEN_UNREF_STRINGS        = 4;
+const unsigned int LIBSTRINGS_OPEN_PARALLEL             = 8;
+const unsigned int LIBSTRINGS_OPEN_COMPRESSED           = 16;
+
+/* The following are the flags that st_save_ex() accepts. */
+const unsigned int LIBSTRINGS_SAVE_INCREMENTAL          = 1;
+
+/* The following are the operations that st_apply_edits() accepts. */
+const unsigned int LIBSTRINGS_EDIT_ADD                  = 0;
+const unsigned int LIBSTRINGS_EDIT_REPLACE              = 1;
+const unsigned int LIBSTRINGS_EDIT_REMOVE               = 2;
+
+/* The following are the ways an overlay selector can choose strings. */
+const unsigned int LIBSTRINGS_SELECT_ALL                = 0;
+const unsigned int LIBSTRINGS_SELECT_PREFIXES           = 1;
+const unsigned int LIBSTRINGS_SELECT_IDS                = 2;
+const unsigned int LIBSTRINGS_SELECT_CALLBACK           = 3;
+
+/* The following are the flags that st_overlay() accepts. */
+const unsigned int LIBSTRINGS_OVERLAY_ADD_MISSING       = 1;
+
+/* The following are the pattern types that st_filter_ids() accepts. */
+const unsigned int LIBSTRINGS_PATTERN_PREFIX            = 0;
+const unsigned int LIBSTRINGS_PATTERN_CONTAINS          = 1;
+
+/* The following are the flags that st_search() accepts. */
+const unsigned int LIBSTRINGS_SEARCH_IGNORE_CASE        = 1;
+
 
 /*------------------------------
    Version Functions
@@ -99,40 +141,115 @@ LIBSTRINGS unsigned int st_get_error_message(const char ** const details) {
     if (details == NULL)
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    *details = extErrorString;
+    *details = extErrorString.get() == NULL ? NULL : extErrorString->c_str();
 
     return LIBSTRINGS_OK;
 }
 
 LIBSTRINGS void st_cleanup() {
-    if (extErrorString != NULL) {
-        delete [] extErrorString;
-        extErrorString = NULL;
-    }
+    extErrorString.reset();
+}
+
+/*------------------------------
+   Statistics Functions
+------------------------------*/
+
+/* Gets the totals of what a handle has done. */
+LIBSTRINGS unsigned int st_get_stats(st_strings_handle sh, st_stats * const stats) {
+    if (sh == NULL || stats == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    sh->GetStats(*stats);
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets the totals of what the library has done. */
+LIBSTRINGS unsigned int st_get_global_stats(st_stats * const stats) {
+    if (stats == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    GlobalStats().Get(*stats);
+
+    return LIBSTRINGS_OK;
 }
 
 /*----------------------------------
    Lifecycle Management Functions
 ----------------------------------*/
 
+/* Sets the locale to get encoding conversions working correctly. This only
+   needs doing once, before the first handle is opened. */
+static boost::once_flag initFlag = BOOST_ONCE_INIT;
+
+static void Initialise() {
+    setlocale(LC_CTYPE, "");
+    locale global_loc = locale();
+    locale loc(global_loc, new boost::filesystem::detail::utf8_codecvt_facet());
+    boost::filesystem::path::imbue(loc);
+}
+
 /* Opens a STRINGS, ILSTRINGS or DLSTRINGS file at path, returning a handle
    sh. If the strings file doesn't exist then a handle for a new file will be
    created. */
 LIBSTRINGS unsigned int st_open(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding) {
+    return st_open_ex(sh, path, fallbackEncoding, LIBSTRINGS_OPEN_UNREF_STRINGS);
+}
+
+/* Opens a STRINGS, ILSTRINGS or DLSTRINGS file at path by memory-mapping it,
+   returning a handle sh. Strings that don't need transcoding are left in the
+   mapping until they are changed. */
+LIBSTRINGS unsigned int st_open_mapped(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding) {
+    return st_open_ex(sh, path, fallbackEncoding, LIBSTRINGS_OPEN_MAPPED | LIBSTRINGS_OPEN_UNREF_STRINGS);
+}
+
+/* Opens a STRINGS, ILSTRINGS or DLSTRINGS file at path, returning a handle
+   sh, with the given open flags. */
+LIBSTRINGS unsigned int st_open_ex(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding, const unsigned int flags) {
     if (sh == NULL || path == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    //Set the locale to get encoding conversions working correctly.
-    setlocale(LC_CTYPE, "");
-    locale global_loc = locale();
-    locale loc(global_loc, new boost::filesystem::detail::utf8_codecvt_facet());
-    boost::filesystem::path::imbue(loc);
+    boost::call_once(initFlag, &Initialise);
 
     //Create handle.
     try {
-        *sh = new _strings_handle_int(path, fallbackEncoding);
+        *sh = new _strings_handle_int(path, fallbackEncoding, flags);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     } catch (error& e) {
         return c_error(e);
+    } catch (exception& e) {
+        return c_error(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what());
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Sets the size limit for the cache of decoded strings. */
+LIBSTRINGS unsigned int st_set_cache_limit(st_strings_handle sh, const size_t bytes) {
+    if (sh == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::unique_lock<boost::shared_mutex> lock(sh->mutex);
+
+    sh->cache.SetLimit(bytes);
+
+    return LIBSTRINGS_OK;
+}
+
+/* Copies the handle's live strings into new memory, freeing any replaced strings. */
+LIBSTRINGS unsigned int st_compact(st_strings_handle sh) {
+    if (sh == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::unique_lock<boost::shared_mutex> lock(sh->mutex);
+
+    try {
+        sh->Compact();
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     }
 
     return LIBSTRINGS_OK;
@@ -140,12 +257,62 @@ LIBSTRINGS unsigned int st_open(st_strings_handle * const sh, const char * const
 
 /* Saves the strings associated with the given handle to the given path. */
 LIBSTRINGS unsigned int st_save(st_strings_handle sh, const char * const path, const char * const encoding) {
-    if (sh == NULL || path == NULL)
+    return st_save_ex(sh, path, encoding, 0);
+}
+
+/* Saves the strings associated with the given handle to the given path,
+   incrementally if asked to and possible. */
+LIBSTRINGS unsigned int st_save_ex(st_strings_handle sh, const char * const path, const char * const encoding, const unsigned int flags) {
+    if (sh == NULL || path == NULL || encoding == NULL)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::unique_lock<boost::shared_mutex> lock(sh->mutex);
+
+    try {
+        if (!(flags & LIBSTRINGS_SAVE_INCREMENTAL) || !sh->SaveIncremental(path, encoding))
+            sh->Save(path, encoding);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Saves a snapshot of the strings associated with the given handle to path. */
+LIBSTRINGS unsigned int st_save_snapshot(st_strings_handle sh, const char * const path) {
+    if (sh == NULL || path == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    try {
+        sh->SaveSnapshot(path);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Opens the strings file at path from the snapshot at snapshotPath,
+   returning a handle sh. */
+LIBSTRINGS unsigned int st_open_snapshot(st_strings_handle * const sh, const char * const snapshotPath, const char * const path) {
+    if (sh == NULL || snapshotPath == NULL || path == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
+    boost::call_once(initFlag, &Initialise);
+
+    //Create handle.
     try {
-        sh->Save(path, encoding);
-    } catch (error e) {
+        const snapshot_file snapshot(snapshotPath, path);
+        *sh = new _strings_handle_int(snapshot, path);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
         return c_error(e);
     }
 
@@ -158,6 +325,47 @@ LIBSTRINGS void st_close(st_strings_handle sh) {
     delete sh;
 }
 
+/* Opens the strings files for the given language in the directory at path,
+   returning a directory handle dh. */
+LIBSTRINGS unsigned int st_open_directory(st_directory_handle * const dh, const char * const path, const char * const language, const char * const fallbackEncoding, const unsigned int flags) {
+    if (dh == NULL || path == NULL || fallbackEncoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::call_once(initFlag, &Initialise);
+
+    //Create handle.
+    try {
+        *dh = new _strings_directory_int(path, language == NULL ? "" : language, fallbackEncoding, flags);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets the files that were opened for the given directory handle. */
+LIBSTRINGS unsigned int st_get_directory_files(st_directory_handle dh, const st_directory_file ** const files, size_t * const numFiles) {
+    if (dh == NULL || files == NULL || numFiles == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    if (dh->files.empty()) {
+        *files = NULL;
+        *numFiles = 0;
+    } else {
+        *files = &dh->files[0];
+        *numFiles = dh->files.size();
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Closes the given directory handle and the handles of the files it opened. */
+LIBSTRINGS void st_close_directory(st_directory_handle dh) {
+    delete dh;
+}
+
 
 /*------------------------------
    String Reading Functions
@@ -168,41 +376,36 @@ LIBSTRINGS unsigned int st_get_strings(st_strings_handle sh, st_string_data ** s
     if (sh == NULL || strings == NULL || numStrings == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    //Free memory if in use.
-    if (sh->extStringDataArr != NULL) {
-        for (size_t i=0; i < sh->extStringDataArrSize; i++)
-            delete [] sh->extStringDataArr[i].data;
-        delete [] sh->extStringDataArr;
-        sh->extStringDataArr = NULL;
-        sh->extStringDataArrSize = 0;
-    }
-
     //Init values.
     *strings = NULL;
     *numStrings = 0;
 
-    if (sh->data.empty())
-        return LIBSTRINGS_OK;
-
-    sh->extStringDataArrSize = sh->data.size();
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
 
     try {
-        sh->extStringDataArr = new st_string_data[sh->extStringDataArrSize];
-        size_t i=0;
-        for (boost::unordered_map<uint32_t, string>::iterator it=sh->data.begin(), endIt=sh->data.end(); it != endIt; ++it) {
-            sh->extStringDataArr[i].id = it->first;
-            sh->extStringDataArr[i].data = ToNewCString(it->second);
-            i++;
+        //Free memory if in use.
+        export_slots& out = sh->Exports();
+        out.FreeStringDataArr();
+
+        if (sh->Size() == 0)
+            return LIBSTRINGS_OK;
+
+        out.stringDataArr = new st_string_data[sh->Size()];
+        for (entry_walker walker(*sh); !walker.AtEnd(); walker.Next()) {
+            out.stringDataArr[out.stringDataArrSize].id = walker.Id();
+            out.stringDataArr[out.stringDataArrSize].data = sh->Copy(walker.Id(), walker.Entry());
+            out.stringDataArrSize++;
         }
+        sh->stats.Add(STAT_EXPORT_ALLOCATIONS, out.stringDataArrSize + 1);
+
+        *strings = out.stringDataArr;
+        *numStrings = out.stringDataArrSize;
     } catch (bad_alloc& e) {
         return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     } catch (error& e) {
         return c_error(e);
     }
 
-    *strings = sh->extStringDataArr;
-    *numStrings = sh->extStringDataArrSize;
-
     return LIBSTRINGS_OK;
 }
 
@@ -211,41 +414,36 @@ LIBSTRINGS unsigned int st_get_unref_strings(st_strings_handle sh, char *** stri
     if (sh == NULL || strings == NULL || numStrings == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    //Free memory if in use.
-    if (sh->extStringArr != NULL) {
-        for (size_t i=0; i < sh->extStringArrSize; i++)
-            delete [] sh->extStringArr[i];
-        delete [] sh->extStringArr;
-        sh->extStringArr = NULL;
-        sh->extStringArrSize = 0;
-    }
-
     //Init values.
     *strings = NULL;
     *numStrings = 0;
 
-    if (sh->unrefStrings.empty())
-        return LIBSTRINGS_OK;
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
 
-    //Allocate memory.
-    sh->extStringArrSize = sh->unrefStrings.size();
     try {
-        sh->extStringArr = new char*[sh->extStringArrSize];
-        //Now loop through the offsets, getting the string for each.
-        size_t i=0;
+        //Free memory if in use.
+        export_slots& out = sh->Exports();
+        out.FreeStringArr();
+
+        if (sh->unrefStrings.empty())
+            return LIBSTRINGS_OK;
+
+        //Allocate memory.
+        out.stringArr = new char*[sh->unrefStrings.size()];
         for (boost::unordered_set<string>::iterator it=sh->unrefStrings.begin(), endIt=sh->unrefStrings.end(); it != endIt; ++it) {
-            sh->extStringArr[i] = ToNewCString(*it);
-            i++;
+            out.stringArr[out.stringArrSize] = ToNewCString(*it);
+            out.stringArrSize++;
         }
+        sh->stats.Add(STAT_EXPORT_ALLOCATIONS, out.stringArrSize + 1);
+
+        *strings = out.stringArr;
+        *numStrings = out.stringArrSize;
     } catch (bad_alloc& e) {
         return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     } catch (error& e) {
         return c_error(e);
     }
 
-    *strings = sh->extStringArr;
-    *numStrings = sh->extStringArrSize;
-
     return LIBSTRINGS_OK;
 }
 
@@ -254,33 +452,465 @@ LIBSTRINGS unsigned int st_get_string(st_strings_handle sh, const uint32_t strin
     if (sh == NULL || string == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    //Free memory in use.
-    if (sh->extString != NULL) {
-        delete [] sh->extString;
-        sh->extString = NULL;
-    }
-
     //Init value.
     *string = NULL;
 
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
     //Find string.
     try {
-        boost::unordered_map<uint32_t, std::string>::iterator it = sh->data.find(stringId);
-        if (it != sh->data.end())
-            sh->extString = ToNewCString(it->second);
-        else
+        //Free memory in use.
+        export_slots& out = sh->Exports();
+        out.FreeString();
+
+        string_entry scratch;
+        string_entry * entry = sh->Find(stringId, scratch);
+        if (entry == NULL)
             return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
+
+        out.string = sh->Copy(stringId, *entry);
+        sh->stats.Add(STAT_EXPORT_ALLOCATIONS, 1);
+        *string = out.string;
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets views of all the strings with IDs, without copying them. */
+LIBSTRINGS unsigned int st_get_strings_view(st_strings_handle sh, const st_string_view ** views, size_t * numViews) {
+    if (sh == NULL || views == NULL || numViews == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //Init values.
+    *views = NULL;
+    *numViews = 0;
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    export_slots * out = NULL;
+    try {
+        //The array's memory is reused between calls.
+        out = &sh->Exports();
+        out->stringViews.clear();
+
+        if (sh->Size() == 0)
+            return LIBSTRINGS_OK;
+
+        out->stringViews.reserve(sh->Size());
+        for (entry_walker walker(*sh); !walker.AtEnd(); walker.Next()) {
+            st_string_view view;
+            view.id = walker.Id();
+            view.data = sh->Pin(walker.Id(), walker.Entry(), view.length);
+            out->stringViews.push_back(view);
+        }
     } catch (bad_alloc& e) {
+        if (out != NULL)
+            out->stringViews.clear();
         return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     } catch (error& e) {
+        if (out != NULL)
+            out->stringViews.clear();
         return c_error(e);
     }
 
-    *string = sh->extString;
+    *views = &out->stringViews[0];
+    *numViews = out->stringViews.size();
 
     return LIBSTRINGS_OK;
 }
 
+/* Gets a view of the string with the given ID, without copying it. */
+LIBSTRINGS unsigned int st_get_string_view(st_strings_handle sh, const uint32_t stringId, st_string_view * view) {
+    if (sh == NULL || view == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //Init value.
+    view->id = stringId;
+    view->data = NULL;
+    view->length = 0;
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    string_entry scratch;
+    string_entry * entry = sh->Find(stringId, scratch);
+    if (entry == NULL)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
+
+    try {
+        view->data = sh->Pin(stringId, *entry, view->length);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets views of the strings with the given IDs, recording which were found. */
+LIBSTRINGS unsigned int st_get_strings_by_ids(st_strings_handle sh, const uint32_t * const ids, const size_t numIds, const st_string_view ** const views, const uint8_t ** const found) {
+    if (sh == NULL || (ids == NULL && numIds > 0) || views == NULL || found == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //Init values.
+    *views = NULL;
+    *found = NULL;
+
+    if (numIds == 0)
+        return LIBSTRINGS_OK;
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    try {
+        export_slots& out = sh->Exports();
+
+        st_string_view missing;
+        missing.data = NULL;
+        missing.length = 0;
+        out.batchViews.assign(numIds, missing);
+        out.batchFound.assign((numIds + 7) / 8, 0);
+
+        /* Look a few IDs ahead and prefetch the first node in their buckets,
+           so that the memory accesses for several lookups overlap instead of
+           each lookup waiting for its own cache misses. If the ID index is
+           built and looks up IDs directly, it finds all the entries first.
+           Handles serving a snapshot search its directory instead. */
+        const size_t lookahead = 8;
+        const id_index * index = sh->IdIndex();
+        if (index != NULL && !index->IsDirect())
+            index = NULL;
+
+        vector<string_entry *> entries;
+        if (index != NULL) {
+            entries.resize(numIds);
+            index->Find(ids, numIds, &entries[0]);
+        }
+
+        const bool prefetch = (index == NULL && !sh->FromSnapshot());
+        string_entry scratch;
+        for (size_t i=0; i < numIds; i++) {
+            if (prefetch && i + lookahead < numIds) {
+                const size_t bucket = sh->data.bucket(ids[i + lookahead]);
+                entry_map::const_local_iterator bucketIt = sh->data.begin(bucket);
+                if (bucketIt != sh->data.end(bucket))
+                    LIBSTRINGS_PREFETCH(&*bucketIt);
+            }
+
+            st_string_view& view = out.batchViews[i];
+            view.id = ids[i];
+
+            string_entry * entry = (index != NULL) ? entries[i] : sh->Find(ids[i], scratch);
+            if (entry != NULL) {
+                view.data = sh->Pin(ids[i], *entry, view.length);
+                out.batchFound[i / 8] |= uint8_t(1 << (i % 8));
+            }
+        }
+
+        *views = &out.batchViews[0];
+        *found = &out.batchFound[0];
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Builds the index that st_get_string_range() uses. */
+LIBSTRINGS unsigned int st_build_id_index(st_strings_handle sh) {
+    if (sh == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    try {
+        sh->BuildIdIndex();
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets views of the strings with IDs from lo to hi, in ID order. */
+LIBSTRINGS unsigned int st_get_string_range(st_strings_handle sh, const uint32_t lo, const uint32_t hi, const st_string_view ** const views, size_t * const numViews) {
+    if (sh == NULL || views == NULL || numViews == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //Init values.
+    *views = NULL;
+    *numViews = 0;
+
+    if (lo > hi)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The range's lowest ID is greater than its highest.");
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    export_slots * out = NULL;
+    try {
+        out = &sh->Exports();
+        sh->GetRange(lo, hi, out->rangeViews);
+    } catch (bad_alloc& e) {
+        if (out != NULL)
+            out->rangeViews.clear();
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        if (out != NULL)
+            out->rangeViews.clear();
+        return c_error(e);
+    }
+
+    if (!out->rangeViews.empty()) {
+        *views = &out->rangeViews[0];
+        *numViews = out->rangeViews.size();
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets the IDs of the strings that match any of the given patterns. */
+LIBSTRINGS unsigned int st_filter_ids(st_strings_handle sh, const st_pattern * const patterns, const size_t numPatterns, const uint32_t ** const ids, size_t * const numIds) {
+    if (sh == NULL || (patterns == NULL && numPatterns > 0) || ids == NULL || numIds == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    for (size_t i=0; i < numPatterns; i++) {
+        if (patterns[i].text == NULL)
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+        else if (patterns[i].type != LIBSTRINGS_PATTERN_PREFIX && patterns[i].type != LIBSTRINGS_PATTERN_CONTAINS)
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Invalid pattern type given.");
+    }
+
+    //Init values.
+    *ids = NULL;
+    *numIds = 0;
+
+    if (numPatterns == 0)
+        return LIBSTRINGS_OK;
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    export_slots * out = NULL;
+    try {
+        pattern_matcher matcher;
+        for (size_t i=0; i < numPatterns; i++) {
+            if (patterns[i].type == LIBSTRINGS_PATTERN_PREFIX)
+                matcher.AddPrefix(patterns[i].text, strlen(patterns[i].text));
+            else
+                matcher.AddSubstring(patterns[i].text, strlen(patterns[i].text));
+        }
+
+        out = &sh->Exports();
+        sh->Filter(matcher, out->filterIds);
+    } catch (bad_alloc& e) {
+        if (out != NULL)
+            out->filterIds.clear();
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        if (out != NULL)
+            out->filterIds.clear();
+        return c_error(e);
+    }
+
+    if (!out->filterIds.empty()) {
+        *ids = &out->filterIds[0];
+        *numIds = out->filterIds.size();
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Builds the index used by st_search(), if it isn't already built. */
+LIBSTRINGS unsigned int st_build_search_index(st_strings_handle sh) {
+    if (sh == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    try {
+        sh->BuildSearchIndex();
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets the IDs of the strings that contain query. */
+LIBSTRINGS unsigned int st_search(st_strings_handle sh, const char * const query, const unsigned int flags, const uint32_t ** const ids, size_t * const numIds) {
+    if (sh == NULL || query == NULL || ids == NULL || numIds == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //Init values.
+    *ids = NULL;
+    *numIds = 0;
+
+    //A query that splits a character could match a capital letter's bytes, which the index doesn't hold.
+    const size_t queryLength = strlen(query);
+    if (!IsValidUTF8(query, queryLength))
+        return c_error(LIBSTRINGS_ERROR_BAD_STRING, "The query is not valid UTF-8.");
+
+    boost::shared_lock<boost::shared_mutex> lock(sh->mutex);
+
+    export_slots * out = NULL;
+    try {
+        out = &sh->Exports();
+        sh->Search(query, queryLength, (flags & LIBSTRINGS_SEARCH_IGNORE_CASE) != 0, out->searchIds);
+    } catch (bad_alloc& e) {
+        if (out != NULL)
+            out->searchIds.clear();
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        if (out != NULL)
+            out->searchIds.clear();
+        return c_error(e);
+    }
+
+    if (!out->searchIds.empty()) {
+        *ids = &out->searchIds[0];
+        *numIds = out->searchIds.size();
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets the IDs that were added, removed or changed going from a to b. */
+LIBSTRINGS unsigned int st_diff(st_strings_handle a, st_strings_handle b, st_diff_result * const result) {
+    if (a == NULL || b == NULL || result == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //Init values.
+    result->added = NULL;
+    result->numAdded = 0;
+    result->removed = NULL;
+    result->numRemoved = 0;
+    result->changed = NULL;
+    result->numChanged = 0;
+
+    if (a == b)
+        return LIBSTRINGS_OK;
+
+    //Lock both handles together, as st_overlay() does.
+    boost::shared_lock<boost::shared_mutex> aLock(a->mutex, boost::defer_lock);
+    boost::shared_lock<boost::shared_mutex> bLock(b->mutex, boost::defer_lock);
+    boost::lock(aLock, bLock);
+
+    export_slots * out = NULL;
+    try {
+        out = &a->Exports();
+        a->Diff(*b, out->diffAdded, out->diffRemoved, out->diffChanged);
+    } catch (bad_alloc& e) {
+        if (out != NULL) {
+            out->diffAdded.clear();
+            out->diffRemoved.clear();
+            out->diffChanged.clear();
+        }
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        if (out != NULL) {
+            out->diffAdded.clear();
+            out->diffRemoved.clear();
+            out->diffChanged.clear();
+        }
+        return c_error(e);
+    }
+
+    if (!out->diffAdded.empty()) {
+        result->added = &out->diffAdded[0];
+        result->numAdded = out->diffAdded.size();
+    }
+    if (!out->diffRemoved.empty()) {
+        result->removed = &out->diffRemoved[0];
+        result->numRemoved = out->diffRemoved.size();
+    }
+    if (!out->diffChanged.empty()) {
+        result->changed = &out->diffChanged[0];
+        result->numChanged = out->diffChanged.size();
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/*------------------------------
+   Streaming Reader Functions
+------------------------------*/
+
+/* Calls callback with each string in the file at path, in file order. */
+LIBSTRINGS unsigned int st_iterate(const char * const path, const char * const fallbackEncoding, st_iterate_callback callback, void * const userdata) {
+    if (path == NULL || fallbackEncoding == NULL || callback == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::call_once(initFlag, &Initialise);
+
+    try {
+        _strings_cursor_int cursor(path, fallbackEncoding);
+        st_string_view view;
+        while (cursor.Next(view)) {
+            if (callback(userdata, view.id, view.data, view.length) != 0)
+                break;
+        }
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Starts walking through the file at path, returning a cursor handle ch. */
+LIBSTRINGS unsigned int st_cursor_open(st_cursor_handle * const ch, const char * const path, const char * const fallbackEncoding) {
+    if (ch == NULL || path == NULL || fallbackEncoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::call_once(initFlag, &Initialise);
+
+    //Create handle.
+    try {
+        *ch = new _strings_cursor_int(path, fallbackEncoding);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets the next string in the file the cursor is walking through. */
+LIBSTRINGS unsigned int st_cursor_next(st_cursor_handle ch, const st_string_view ** const view) {
+    if (ch == NULL || view == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //Init value.
+    *view = NULL;
+
+    boost::lock_guard<boost::mutex> lock(ch->mutex);
+
+    try {
+        if (ch->Next(ch->view))
+            *view = &ch->view;
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Closes the given cursor handle. */
+LIBSTRINGS void st_cursor_close(st_cursor_handle ch) {
+    delete ch;
+}
+
 
 /*------------------------------
    String Writing Functions
@@ -291,19 +921,16 @@ LIBSTRINGS unsigned int st_set_strings(st_strings_handle sh, const st_string_dat
     if (sh == NULL || strings == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    boost::unordered_map<uint32_t, string> newMap;
+    boost::unique_lock<boost::shared_mutex> lock(sh->mutex);
 
     try {
-        for (size_t i=0; i < numStrings; i++) {
-            if (!newMap.insert(pair<uint32_t, string>(strings[i].id, strings[i].data)).second)
-                return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The ID given for the string \"" + string(strings[i].data) + "\" already exists.");
-        }
+        sh->SetAll(strings, numStrings);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     } catch (error& e) {
         return c_error(e);
     }
 
-    sh->data = newMap;
-
     return LIBSTRINGS_OK;
 }
 
@@ -312,9 +939,18 @@ LIBSTRINGS unsigned int st_add_string(st_strings_handle sh, const uint32_t strin
     if (sh == NULL || str == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    if (!sh->data.insert(pair<uint32_t, string>(stringId, str)).second)
+    boost::unique_lock<boost::shared_mutex> lock(sh->mutex);
+
+    string_entry scratch;
+    if (sh->Find(stringId, scratch) != NULL)
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID already exists.");
 
+    try {
+        sh->Set(stringId, str, strlen(str));
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    }
+
     return LIBSTRINGS_OK;
 }
 
@@ -323,11 +959,17 @@ LIBSTRINGS unsigned int st_replace_string(st_strings_handle sh, const uint32_t s
     if (sh == NULL || newString == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    boost::unordered_map<uint32_t, string>::iterator it = sh->data.find(stringId);
-    if (it == sh->data.end())
+    boost::unique_lock<boost::shared_mutex> lock(sh->mutex);
+
+    string_entry scratch;
+    if (sh->Find(stringId, scratch) == NULL)
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
 
-    it->second = newString;
+    try {
+        sh->Set(stringId, newString, strlen(newString));
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    }
 
     return LIBSTRINGS_OK;
 }
@@ -337,11 +979,144 @@ LIBSTRINGS unsigned int st_remove_string(st_strings_handle sh, const uint32_t st
     if (sh == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    boost::unordered_map<uint32_t, string>::iterator it = sh->data.find(stringId);
-    if (it == sh->data.end())
-        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
+    boost::unique_lock<boost::shared_mutex> lock(sh->mutex);
+
+    try {
+        if (!sh->Erase(stringId))
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Applies the given edits, or none of them if any is invalid. */
+LIBSTRINGS unsigned int st_apply_edits(st_strings_handle sh, const st_string_edit * const edits, const size_t numEdits, const uint8_t ** const statuses) {
+    if (sh == NULL || (edits == NULL && numEdits > 0) || statuses == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //Init value.
+    *statuses = NULL;
+
+    if (numEdits == 0)
+        return LIBSTRINGS_OK;
+
+    boost::unique_lock<boost::shared_mutex> lock(sh->mutex);
 
-    sh->data.erase(it);
+    try {
+        export_slots& out = sh->Exports();
+        const bool applied = sh->ApplyEdits(edits, numEdits, out.editStatuses);
+        *statuses = &out.editStatuses[0];
+        if (!applied)
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "One or more of the given edits are invalid.");
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    }
 
     return LIBSTRINGS_OK;
 }
+
+
+/* Copies the strings in src chosen by the selector into dst. */
+LIBSTRINGS unsigned int st_overlay(st_strings_handle dst, st_strings_handle src, const st_overlay_selector * const selector, const unsigned int flags) {
+    if (dst == NULL || src == NULL || selector == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if (selector->type == LIBSTRINGS_SELECT_PREFIXES) {
+        if (selector->prefixes == NULL && selector->numPrefixes > 0)
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+        for (size_t i=0; i < selector->numPrefixes; i++) {
+            if (selector->prefixes[i] == NULL)
+                return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+        }
+    } else if (selector->type == LIBSTRINGS_SELECT_IDS) {
+        if (selector->ids == NULL && selector->numIds > 0)
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    } else if (selector->type == LIBSTRINGS_SELECT_CALLBACK) {
+        if (selector->callback == NULL)
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    } else if (selector->type != LIBSTRINGS_SELECT_ALL)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Invalid selector type given.");
+
+    if (dst == src)
+        return LIBSTRINGS_OK;
+
+    //Lock both handles together, so that overlays in opposite directions can't deadlock.
+    boost::unique_lock<boost::shared_mutex> dstLock(dst->mutex, boost::defer_lock);
+    boost::shared_lock<boost::shared_mutex> srcLock(src->mutex, boost::defer_lock);
+    boost::lock(dstLock, srcLock);
+
+    try {
+        dst->Overlay(*src, *selector, (flags & LIBSTRINGS_OVERLAY_ADD_MISSING) != 0);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/*------------------------------
+   Streaming Writer Functions
+------------------------------*/
+
+/* Starts writing a strings file at path, returning a writer handle wh. */
+LIBSTRINGS unsigned int st_writer_open(st_writer_handle * const wh, const char * const path, const char * const encoding) {
+    if (wh == NULL || path == NULL || encoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::call_once(initFlag, &Initialise);
+
+    //Create handle.
+    try {
+        *wh = new _strings_writer_int(path, encoding);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Adds the given string with the given ID to the file being written. */
+LIBSTRINGS unsigned int st_writer_add(st_writer_handle wh, const uint32_t stringId, const char * const str) {
+    if (wh == NULL || str == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::lock_guard<boost::mutex> lock(wh->mutex);
+
+    try {
+        wh->Add(stringId, str, strlen(str));
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Writes the strings added to the writer to its file. */
+LIBSTRINGS unsigned int st_writer_finish(st_writer_handle wh) {
+    if (wh == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    boost::lock_guard<boost::mutex> lock(wh->mutex);
+
+    try {
+        wh->Finish();
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Closes the given writer handle, deleting its temporary file. */
+LIBSTRINGS void st_writer_close(st_writer_handle wh) {
+    delete wh;
+}
@@ -25,7 +25,11 @@
     @file libstrings.h
     @brief This file contains the API frontend.
 
-    @note libstrings is *not* thread safe. Thread safety is a goal, but one that has not yet been achieved. Bear this in mind if using it in a multi-threaded client.
+    @section thread_sec Thread Safety
+
+    libstrings is thread safe. Any number of threads can call the string reading functions on the same handle at the same time, while functions that change a handle, set its cache limit, compact it or save it wait for other threads' calls on the handle to finish, and make them wait until it has finished. st_close() must not be called while another thread is using the handle. Calls on a writer or cursor handle made by different threads are made one at a time.
+
+    Errors are recorded per thread, so st_get_error_message() gives the details of the last error encountered by the calling thread.
 
     @section var_sec Variable Types
 
@@ -39,9 +43,9 @@
 
     libloadorder manages the memory of strings and arrays it returns internally, so such strings and arrays should not be deallocated by the client.
 
-    Data returned by a function lasts until a function is called which returns data of the same type (eg. a string is stored until the client calls another function which returns a string, an integer array lasts until another integer array is returned, etc.).
+    Data returned by a function lasts until a function is called which returns data of the same type (eg. a string is stored until the client calls another function which returns a string, an integer array lasts until another integer array is returned, etc.). The data returned for a handle is kept separately for each thread, so one thread's calls don't free the data returned to another.
 
-    All allocated memory is freed when st_close() is called, except the string allocated by st_get_error_message(), which must be freed by calling st_cleanup().
+    All allocated memory is freed when st_close() is called, except the string allocated by st_get_error_message(), which is freed when the thread exits, or by calling st_cleanup() from that thread.
 */
 
 #ifndef __LIBSTRINGS_H__
@@ -92,10 +96,35 @@ extern "C"
 
 /**
     @brief A structure that holds all game-specific data used by libstrings.
-    @details Used to keep each strings file's data independent. Abstracts the definition of libstrings' internal state while still providing type safety across the library's functions. Multiple handles can also be made for each strings file, though it should be kept in mind that libstrings is not thread-safe.
+    @details Used to keep each strings file's data independent. Abstracts the definition of libstrings' internal state while still providing type safety across the library's functions. Multiple handles can also be made for each strings file, and each handle can be used by multiple threads.
 */
 typedef struct _strings_handle_int * st_strings_handle;
 
+/**
+    @brief A structure that holds the strings files opened from a directory.
+    @details Created by st_open_directory(), and owns the handles of the files it opened.
+*/
+typedef struct _strings_directory_int * st_directory_handle;
+
+/**
+    @brief A structure that holds the state of a strings file being written by st_writer_open().
+    @details Only the IDs and the locations of the strings written are held in memory, so files can be written using much less memory than building them in a handle would take.
+*/
+typedef struct _strings_writer_int * st_writer_handle;
+
+/**
+    @brief A structure that holds the position of a walk through a strings file started by st_cursor_open().
+    @details Holds no more than the file's mapping and one string, however large the file is.
+*/
+typedef struct _strings_cursor_int * st_cursor_handle;
+
+/**
+    @brief The type of function that st_iterate() calls for each string.
+    @details data is a null-terminated UTF-8 string of length bytes, which is only valid until the function returns.
+    @returns `0` to carry on to the next string, or any other value to stop.
+*/
+typedef int (*st_iterate_callback)(void * userdata, uint32_t id, const char * data, size_t length);
+
 /**
     @brief A structure holding the ID and corresponding data of a string.
     @details Used by st_get_strings() and st_set_strings() to ensure IDs and string data don't get mixed up.
@@ -105,6 +134,104 @@ typedef struct {
         char * data;
 } st_string_data;
 
+/**
+    @brief A structure holding the ID of a string and a pointer to its data in a handle's memory.
+    @details Used by st_get_strings_view() and st_get_string_view() to give access to strings without copying them. The data is null-terminated, and length excludes the terminator.
+*/
+typedef struct {
+        uint32_t id;
+        const char * data;
+        size_t length;
+} st_string_view;
+
+/**
+    @brief A structure holding the result of opening a strings file found by st_open_directory().
+    @details If the file was opened, status is `LIBSTRINGS_OK` and message is `NULL`. Otherwise handle is `NULL`, status is the code that opening the file returned, and message gives its details.
+*/
+typedef struct {
+        const char * path;
+        st_strings_handle handle;
+        unsigned int status;
+        const char * message;
+} st_directory_file;
+
+/**
+    @brief A structure describing a change to make to a string, for use with st_apply_edits().
+    @details op is one of the edit operations. For `LIBSTRINGS_EDIT_REMOVE`, data is ignored.
+*/
+typedef struct {
+        unsigned int op;
+        uint32_t id;
+        const char * data;
+} st_string_edit;
+
+/**
+    @brief The type of function that an overlay selector can use to choose which strings st_overlay() copies.
+    @details The views are only valid until the function returns.
+    @param userdata The pointer given in the selector.
+    @param dstString The string with the same ID in the handle being copied into, or `NULL` if it has no string with that ID.
+    @param srcString The string in the handle being copied from.
+    @returns A non-zero value to copy the string, or `0` to skip it.
+*/
+typedef int (*st_overlay_callback)(void * userdata, const st_string_view * dstString, const st_string_view * srcString);
+
+/**
+    @brief A structure describing which strings st_overlay() copies.
+    @details type is one of the selector types, and only the fields it uses need to be set. `LIBSTRINGS_SELECT_PREFIXES` uses prefixes and numPrefixes, and matches the strings being copied if matchSource is true, or the strings they would replace otherwise. `LIBSTRINGS_SELECT_IDS` uses ids and numIds. `LIBSTRINGS_SELECT_CALLBACK` uses callback, which is passed userdata unchanged. If invert is true, the strings that would not be selected are copied instead.
+*/
+typedef struct {
+        unsigned int type;
+        const char * const * prefixes;
+        size_t numPrefixes;
+        bool matchSource;
+        const uint32_t * ids;
+        size_t numIds;
+        st_overlay_callback callback;
+        void * userdata;
+        bool invert;
+} st_overlay_selector;
+
+/**
+    @brief A structure describing a pattern for st_filter_ids() to look for in strings.
+    @details text is a null-terminated UTF-8 string, and type is one of the pattern types. An empty pattern matches every string.
+*/
+typedef struct {
+        const char * text;
+        unsigned int type;
+} st_pattern;
+
+/**
+    @brief A structure holding the IDs of the strings that differ between two handles, as output by st_diff().
+    @details Each array holds IDs in ascending order, and is `NULL` if it is empty.
+*/
+typedef struct {
+        const uint32_t * added;
+        size_t numAdded;
+        const uint32_t * removed;
+        size_t numRemoved;
+        const uint32_t * changed;
+        size_t numChanged;
+} st_diff_result;
+
+/**
+    @brief A structure holding the totals of what a handle, or the library as a whole, has done.
+    @details Byte counts include files mapped as well as read. Strings are counted as decoded when they are checked for being valid UTF-8, and as transcoded when they are then converted. Dedup hits are the strings that saving found had already been written for another ID. Export allocations are the arrays and strings allocated for the caller by st_get_strings(), st_get_unref_strings() and st_get_string(). Times are in nanoseconds: parsing includes the validation and transcoding done while opening, and deduplication is the time spent laying out strings to save, excluding transcoding.
+*/
+typedef struct {
+        uint64_t bytesRead;
+        uint64_t bytesWritten;
+        uint64_t stringsDecoded;
+        uint64_t stringsTranscoded;
+        uint64_t dedupHits;
+        uint64_t exportAllocations;
+        uint64_t readNanoseconds;
+        uint64_t parseNanoseconds;
+        uint64_t validateNanoseconds;
+        uint64_t transcodeNanoseconds;
+        uint64_t dedupNanoseconds;
+        uint64_t writeNanoseconds;
+} st_stats;
+
 /*********************//**
     @name Return Codes
     @brief Error codes signify an issue that caused a function to exit prematurely. If a function exits prematurely, a reversal of any changes made during its execution is attempted before it exits.
@@ -126,6 +253,86 @@ LIBSTRINGS extern const unsigned int LIBSTRINGS_RETURN_MAX;
 
 ///@}
 
+/*********************//**
+    @name Open Flags
+    @brief Flags that can be combined to change how st_open_ex() opens a file.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_OPEN_MAPPED;  ///< Memory-map the file instead of reading it into memory. See st_open_mapped().
+LIBSTRINGS extern const unsigned int LIBSTRINGS_OPEN_LAZY;  ///< Only read the directory when opening the file, and decode each string when it is first accessed. Strings that need transcoding are held in a size-limited cache (see st_set_cache_limit()).
+LIBSTRINGS extern const unsigned int LIBSTRINGS_OPEN_UNREF_STRINGS;  ///< Look for strings in the file that are not assigned IDs, so that they can be got using st_get_unref_strings(). Without this flag, no unreferenced strings are found.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_OPEN_PARALLEL;  ///< Split checking and transcoding the strings between as many threads as there are processor cores, for files large enough to benefit. Has no effect with `LIBSTRINGS_OPEN_LAZY`.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_OPEN_COMPRESSED;  ///< Hold long strings compressed, using a table of common byte sequences picked to suit the file, which typically halves the memory they use. Each string is decompressed when it is accessed, into the caller's copy or into the handle's cache (see st_set_cache_limit()), and views of it keep it decompressed until st_compact() is called. Strings are decoded while the file is opened, so `LIBSTRINGS_OPEN_LAZY` has no effect, and a mapped file is closed once its strings are compressed.
+
+///@}
+
+/*********************//**
+    @name Save Flags
+    @brief Flags that can be combined to change how st_save_ex() saves a file.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_SAVE_INCREMENTAL;  ///< If saving to the file the handle was last read from or saved to, only write the strings that have changed since. See st_save_ex().
+
+///@}
+
+/*********************//**
+    @name Edit Operations
+    @brief The operations that an edit passed to st_apply_edits() can perform.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_EDIT_ADD;  ///< Add a string with an ID that doesn't exist, as st_add_string() does.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_EDIT_REPLACE;  ///< Replace the string with an ID that exists, as st_replace_string() does.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_EDIT_REMOVE;  ///< Remove the string with an ID that exists, as st_remove_string() does.
+
+///@}
+
+/*********************//**
+    @name Selector Types
+    @brief The ways an overlay selector passed to st_overlay() can choose strings.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_SELECT_ALL;  ///< Select every string.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_SELECT_PREFIXES;  ///< Select IDs whose string starts with any of the selector's prefixes. When matching the strings being replaced, an ID with no string to replace matches no prefixes.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_SELECT_IDS;  ///< Select the IDs in the selector's array of IDs.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_SELECT_CALLBACK;  ///< Select the strings that the selector's callback returns a non-zero value for.
+
+///@}
+
+/*********************//**
+    @name Overlay Flags
+    @brief Flags that can be combined to change how st_overlay() copies strings.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_OVERLAY_ADD_MISSING;  ///< Also add selected strings whose IDs the handle being copied into doesn't have. Without this flag, only strings with IDs the handle already has are replaced.
+
+///@}
+
+/*********************//**
+    @name Pattern Types
+    @brief The ways a pattern passed to st_filter_ids() can match a string.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_PATTERN_PREFIX;  ///< Match strings that start with the pattern.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_PATTERN_CONTAINS;  ///< Match strings that contain the pattern anywhere.
+
+///@}
+
+/*********************//**
+    @name Search Flags
+    @brief Flags that can be combined to change how st_search() matches strings.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_SEARCH_IGNORE_CASE;  ///< Treat capital and small letters as the same. Only letters in the Latin, Greek and Cyrillic alphabets have case.
+
+///@}
+
 
 /**************************//**
     @name Version Functions
@@ -160,19 +367,43 @@ LIBSTRINGS void st_get_version(unsigned int * const versionMajor, unsigned int *
 
 /**
    @brief Returns the message for the last error or warning encountered.
-   @details Outputs a string giving the a message containing the details of the last error or warning encountered by a function. Each time this function is called, the memory for the previous message is freed, so only one error message is available at any one time.
+   @details Outputs a string giving the a message containing the details of the last error or warning encountered by a function called by the calling thread. Each time an error is encountered, the memory for the thread's previous message is freed, so only one error message is available to each thread at any one time.
    @param details A pointer to the error details string outputted by the function.
    @returns A return code.
 */
 LIBSTRINGS unsigned int st_get_error_message(const char ** const details);
 
 /**
-   @brief Frees the memory allocated to the last error details string.
+   @brief Frees the memory allocated to the calling thread's last error details string.
 */
 LIBSTRINGS void st_cleanup();
 
 ///@}
 
+/*********************************//**
+    @name Statistics Functions
+*************************************/
+///@{
+
+/**
+    @brief Gets the totals of what a handle has done since it was opened.
+    @details Statistics are kept using relaxed atomic counters and the processor's timestamp counter, so are cheap enough to leave enabled. If the library was built with `LIBSTRINGS_NO_STATS` defined, no statistics are kept and all the totals are zero.
+    @param sh The handle the function acts on.
+    @param stats A pointer to the structure the totals are output to.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_stats(st_strings_handle sh, st_stats * const stats);
+
+/**
+    @brief Gets the totals of what the library has done since it was loaded.
+    @details The totals include everything counted for every handle, including those since closed, as well as what the streaming reader and writer functions have done.
+    @param stats A pointer to the structure the totals are output to.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_global_stats(st_stats * const stats);
+
+///@}
+
 
 /***************************************//**
     @name Lifecycle Management Functions
@@ -189,6 +420,44 @@ LIBSTRINGS void st_cleanup();
 */
 LIBSTRINGS unsigned int st_open(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding);
 
+/**
+    @brief Initialise a new strings handle from a memory-mapped file.
+    @details Behaves as st_open(), except that the file is memory-mapped read-only rather than read into memory, and strings that don't need transcoding are kept as views into the mapping instead of being copied. A string is only copied when it is replaced. The file must not be modified by anything else while the handle is open, though it may be overwritten by st_save() on the same handle.
+    @param sh A pointer to the handle that is created by the function.
+    @param path A string containing the relative or absolute path to the strings file to be opened. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_open_mapped(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding);
+
+/**
+    @brief Initialise a new strings handle using the given open flags.
+    @details Behaves as st_open(), except that the file is opened as described by the given flags. st_open() is equivalent to passing `LIBSTRINGS_OPEN_UNREF_STRINGS`, and st_open_mapped() to passing `LIBSTRINGS_OPEN_MAPPED | LIBSTRINGS_OPEN_UNREF_STRINGS`.
+    @param sh A pointer to the handle that is created by the function.
+    @param path A string containing the relative or absolute path to the strings file to be opened. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param flags Zero or more of the open flags, combined using bitwise OR.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_open_ex(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding, const unsigned int flags);
+
+/**
+    @brief Sets the size limit of a handle's decoded string cache.
+    @details Handles opened with `LIBSTRINGS_OPEN_LAZY` keep strings that have been transcoded from the fallback encoding in a cache, and handles opened with `LIBSTRINGS_OPEN_COMPRESSED` keep strings that have been decompressed in it, discarding the least recently used strings once their total size exceeds the limit. The default limit is 1 MiB. Other handles don't use the cache.
+    @param sh The handle the function acts on.
+    @param bytes The maximum total size of the cached strings, in bytes.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_set_cache_limit(st_strings_handle sh, const size_t bytes);
+
+/**
+    @brief Frees the memory used by strings that have been replaced or removed.
+    @details Strings are stored in a handle's memory without being freed individually, so replacing or removing strings doesn't reduce the handle's memory usage. This function copies the strings that are still in use into new memory and frees the old memory. Pointers to strings previously returned by the handle's functions are invalidated. Handles opened with `LIBSTRINGS_OPEN_COMPRESSED` also compress the long strings that have been added or viewed since they were opened or last compacted.
+    @param sh The handle the function acts on.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_compact(st_strings_handle sh);
+
 /**
     @brief Saves the strings associated with a handle.
     @details Saves the strings associated with the given handle to the given path, using the given encoding. Duplicate string entries are skipped, as are any unreferenced strings. If a file is loaded then saved by libstrings, the order of its contents may not match their order in the original file. This does not affect Skyrim's handling of the files, as the order does not matter.
@@ -199,6 +468,36 @@ LIBSTRINGS unsigned int st_open(st_strings_handle * const sh, const char * const
 */
 LIBSTRINGS unsigned int st_save(st_strings_handle sh, const char * const path, const char * const encoding);
 
+/**
+    @brief Saves the strings associated with a handle, with options.
+    @details Saves as st_save() does, unless `LIBSTRINGS_SAVE_INCREMENTAL` is given and the file at path is the file the handle was last read from or saved to. In that case, if the file hasn't been changed by anything else since, and the handle has the same number of strings as the file, only the strings that have been added or replaced since are written. They are appended to the file's data block, and only their directory entries and the file's header are rewritten. Strings that haven't changed are left as they are in the file, so if the encoding isn't the one the file was read or last written in, a full save is done instead. Replaced strings are left in the file as unreferenced strings, until the data block has doubled in size since it was last fully written, at which point a full save is done instead. A full save is also done whenever an incremental save isn't possible, or after st_set_strings() has been called.
+    @param sh The handle the function acts on.
+    @param path A string containing the relative or absolute path to the strings file to be saved to. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param encoding The encoding in which the strings should be written. Accepted values are `UTF-8`, `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param flags Zero or more of the save flags, combined using bitwise OR.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_save_ex(st_strings_handle sh, const char * const path, const char * const encoding, const unsigned int flags);
+
+/**
+    @brief Saves a snapshot of a handle's strings, for st_open_snapshot() to reopen quickly.
+    @details A snapshot holds the strings already decoded to UTF-8, sorted by ID and with their lengths and hashes, in a layout that can be used straight from a memory-mapped file. It also records the size and modification time of the strings file the handle was opened from or last saved to, and a hash of that file's directory, and the snapshot isn't used if any of them have changed. The file's strings aren't hashed, so if they are changed without changing its size, modification time or directory, the snapshot's strings are used anyway. Unreferenced strings are not included. The handle must not have been changed since it was opened or saved, so that its strings match the file's. Any existing snapshot at path is replaced in one step, so other processes never see a half-written snapshot.
+    @param sh The handle the function acts on.
+    @param path A string containing the relative or absolute path to the snapshot to be saved to.
+    @returns A return code. `LIBSTRINGS_ERROR_INVALID_ARGS` is returned if the handle or its strings file has changed since the file was read or saved.
+*/
+LIBSTRINGS unsigned int st_save_snapshot(st_strings_handle sh, const char * const path);
+
+/**
+    @brief Opens a strings file from a snapshot of it.
+    @details Memory-maps a snapshot saved by st_save_snapshot() and uses the strings from it as they are, without reading, checking or transcoding them, so this is much faster than opening the strings file itself. The handle is otherwise as if the strings file had been opened with st_open_mapped(), and can be saved to it incrementally. If the snapshot doesn't exist, is corrupt, or the strings file's size, modification time or directory has changed since the snapshot was saved, `LIBSTRINGS_ERROR_FILE_READ_FAIL` is returned, and the strings file should be opened normally instead, after which a new snapshot can be saved.
+    @param sh A pointer to the handle that is created by the function.
+    @param snapshotPath A string containing the relative or absolute path to the snapshot to be opened.
+    @param path A string containing the relative or absolute path to the strings file the snapshot was saved from.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_open_snapshot(st_strings_handle * const sh, const char * const snapshotPath, const char * const path);
+
 /**
     @brief Closes an existing handle.
     @details Closes an existing handle, freeing any memory allocated during its use.
@@ -206,6 +505,34 @@ LIBSTRINGS unsigned int st_save(st_strings_handle sh, const char * const path, c
 */
 LIBSTRINGS void st_close(st_strings_handle sh);
 
+/**
+    @brief Opens all the strings files for a language in a directory.
+    @details Finds the STRINGS, DLSTRINGS and ILSTRINGS files in the given directory whose names end in an underscore followed by the given language (eg. `Skyrim_English.STRINGS` for `English`), and opens them concurrently, using as many threads as there are processor cores. Each file is opened as st_open_ex() would open it. A file that fails to open doesn't stop the others being opened: use st_get_directory_files() to get each file's handle and status.
+    @param dh A pointer to the directory handle that is created by the function.
+    @param path A string containing the relative or absolute path to the directory to look in. Subdirectories are not searched.
+    @param language The language to open the strings files for, which is matched case-insensitively. If `NULL` or empty, all strings files in the directory are opened.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the files that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param flags Zero or more of the open flags, combined using bitwise OR.
+    @returns A return code. An error is only returned if the directory could not be read.
+*/
+LIBSTRINGS unsigned int st_open_directory(st_directory_handle * const dh, const char * const path, const char * const language, const char * const fallbackEncoding, const unsigned int flags);
+
+/**
+    @brief Gets the files opened by st_open_directory().
+    @details The files are sorted by path. The array, and the handles in it, are owned by the directory handle: the handles must not be closed using st_close().
+    @param dh The directory handle the function acts on.
+    @param files The outputted array of files. If numFiles is `0`, this will be `NULL`.
+    @param numFiles The size of the outputted array.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_directory_files(st_directory_handle dh, const st_directory_file ** const files, size_t * const numFiles);
+
+/**
+    @brief Closes a directory handle and all the strings file handles it holds.
+    @param dh The directory handle to close.
+*/
+LIBSTRINGS void st_close_directory(st_directory_handle dh);
+
 ///@}
 
 
@@ -225,6 +552,7 @@ LIBSTRINGS unsigned int st_get_strings(st_strings_handle sh, st_string_data ** c
 
 /**
     @brief Gets an array any strings that are associated with the given handle but lack IDs.
+    @details Unreferenced strings are only looked for when a file is opened using st_open(), st_open_mapped() or st_open_ex() with the `LIBSTRINGS_OPEN_UNREF_STRINGS` flag.
     @param sh The handle the function acts on.
     @param strings The outputted array of strings. If numStrings is `0`, this will be `NULL`.
     @param numStrings The size of the outputted array.
@@ -242,6 +570,144 @@ LIBSTRINGS unsigned int st_get_unref_strings(st_strings_handle sh, char *** cons
 */
 LIBSTRINGS unsigned int st_get_string(st_strings_handle sh, const uint32_t stringId, char ** const string);
 
+/**
+    @brief Gets an array of views of all strings with assigned IDs, that are associated with the given handle.
+    @details Behaves as st_get_strings(), except that the strings are not copied: each view points to a string in the handle's memory. The array and the strings it points to remain valid until this function is next called on the handle, the handle is modified, compacted, saved or closed. Handles opened with `LIBSTRINGS_OPEN_LAZY` keep any strings transcoded by this function in their memory rather than in their cache, as handles opened with `LIBSTRINGS_OPEN_COMPRESSED` do with the strings they decompress.
+    @param sh The handle the function acts on.
+    @param views The outputted array of views. If numViews is `0`, this will be `NULL`.
+    @param numViews The size of the outputted array.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_strings_view(st_strings_handle sh, const st_string_view ** const views, size_t * const numViews);
+
+/**
+    @brief Gets a view of the string with the given ID.
+    @details Behaves as st_get_string(), except that the string is not copied. The view remains valid until the handle is next modified, compacted, saved or closed.
+    @param sh The handle the function acts on.
+    @param stringId The ID for which to return the associated string.
+    @param view The outputted view. If no string with the given ID is found, its data will be `NULL` and its length `0`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_string_view(st_strings_handle sh, const uint32_t stringId, st_string_view * const view);
+
+/**
+    @brief Gets views of the strings with the given IDs.
+    @details Looks up all the given IDs in one call, which is much faster than calling st_get_string() for each. As with st_get_string_view(), the strings are not copied. An ID that doesn't exist isn't an error: its view's data is `NULL` and its bit in the found bitmap is not set. The outputted arrays remain valid until this function is next called on the handle by the same thread, and the strings until the handle is next modified, compacted, saved or closed.
+    @param sh The handle the function acts on.
+    @param ids An array of the IDs to get the strings for. IDs may be repeated.
+    @param numIds The size of the ids array.
+    @param views The outputted array of views, in the same order as ids. If numIds is `0`, this will be `NULL`.
+    @param found The outputted bitmap of the IDs that were found, with one bit per ID: the string for `ids[i]` was found if bit `i % 8` of `found[i / 8]` is set. If numIds is `0`, this will be `NULL`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_strings_by_ids(st_strings_handle sh, const uint32_t * const ids, const size_t numIds, const st_string_view ** const views, const uint8_t ** const found);
+
+/**
+    @brief Builds the sorted ID index that st_get_string_range() uses.
+    @details The index holds the handle's IDs in ascending order, laid out so that searching it is cache-friendly. It is built by the first range query after the handle is opened or modified. If the IDs are dense, i.e. there are no more than four times as many possible IDs between the lowest and highest as there are strings, the index also holds a table of every possible ID, which st_get_string(), st_get_string_view() and st_get_strings_by_ids() then use, as it's quicker than the handle's hash table. This function can be used to build it beforehand. It does nothing if the index has already been built.
+    @param sh The handle the function acts on.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_build_id_index(st_strings_handle sh);
+
+/**
+    @brief Gets views of the strings with IDs in the given range, in ascending order of ID.
+    @details The range includes both of its bounds, so passing `0` and `UINT32_MAX` iterates over every string in ID order. As with st_get_string_view(), the strings are not copied. The outputted array remains valid until this function is next called on the handle by the same thread, and the strings until the handle is next modified, compacted, saved or closed.
+    @param sh The handle the function acts on.
+    @param lo The lowest ID to get.
+    @param hi The highest ID to get. Must not be less than lo.
+    @param views The outputted array of views. If no IDs are in the range, this will be `NULL`.
+    @param numViews The size of the outputted array.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_string_range(st_strings_handle sh, const uint32_t lo, const uint32_t hi, const st_string_view ** const views, size_t * const numViews);
+
+/**
+    @brief Gets the IDs of the strings that match any of the given patterns.
+    @details All the patterns are looked for together in a single pass over each string, using vectorised instructions where the CPU supports them. The IDs found can be used to select strings for removal, export or st_overlay(). The outputted array remains valid until this function is next called on the handle by the same thread.
+    @param sh The handle the function acts on.
+    @param patterns An array of the patterns to look for.
+    @param numPatterns The size of the patterns array. If `0`, no strings match.
+    @param ids The outputted array of the IDs of the matching strings, in no particular order. If no strings match, this will be `NULL`.
+    @param numIds The size of the outputted array.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_filter_ids(st_strings_handle sh, const st_pattern * const patterns, const size_t numPatterns, const uint32_t ** const ids, size_t * const numIds);
+
+/**
+    @brief Builds the index that st_search() uses.
+    @details The index is built by the first search after the handle is opened or modified, which can take a while for large files. This function can be used to build it beforehand, so that the first search is as fast as later ones. It does nothing if the index has already been built.
+    @param sh The handle the function acts on.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_build_search_index(st_strings_handle sh);
+
+/**
+    @brief Gets the IDs of the strings that contain the given text.
+    @details Searches an index of the handle's strings, so that only strings that may contain the text are looked at. The index holds a copy of every string, and is freed when the handle is modified, to be rebuilt by the next search. The outputted array remains valid until this function is next called on the handle by the same thread.
+    @param sh The handle the function acts on.
+    @param query The null-terminated UTF-8 text to search for. An empty string matches every string. If query is not valid UTF-8, `LIBSTRINGS_ERROR_BAD_STRING` is returned.
+    @param flags Zero or more of the search flags, combined using bitwise OR.
+    @param ids The outputted array of the IDs of the matching strings, in ascending order. If no strings match, this will be `NULL`.
+    @param numIds The size of the outputted array.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_search(st_strings_handle sh, const char * const query, const unsigned int flags, const uint32_t ** const ids, size_t * const numIds);
+
+/**
+    @brief Gets the IDs of the strings that differ between two handles.
+    @details Walks through the IDs of both handles once, in ascending order. IDs that only b has are added, IDs that only a has are removed, and IDs that both have with different strings are changed. Strings are compared using 64-bit hashes of their UTF-8 text, so files in different encodings can be compared, and unchanged strings are never compared byte by byte or copied. Each handle hashes its strings the first time it is diffed after being opened or modified, decoding them as reading functions do if it was opened with `LIBSTRINGS_OPEN_LAZY`. Handles opened using st_open_snapshot() use the hashes saved in the snapshot, without reading their strings. The outputted arrays remain valid until this function is next called with a as the first handle by the same thread.
+    @param a The handle holding the old strings.
+    @param b The handle holding the new strings.
+    @param result The outputted IDs. If a and b are the same handle, all the arrays are empty.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_diff(st_strings_handle a, st_strings_handle b, st_diff_result * const result);
+
+///@}
+
+
+/***************************************//**
+    @name Streaming Reader Functions
+    @brief Read every string in a file once, in file order, without opening a handle.
+*******************************************/
+///@{
+
+/**
+    @brief Calls a function for each string in a strings file.
+    @details The file's directory entries are visited in the order they are in the file, including any repeated IDs, which st_open() would skip. Unreferenced strings are not visited. Strings that are valid UTF-8 are passed straight from the mapped file, and other strings are transcoded from the fallback encoding one at a time, so memory use doesn't depend on the size of the file.
+    @param path A string containing the relative or absolute path to the strings file to be read. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param callback The function to call for each string. If it returns a non-zero value, no more strings are visited and this function returns `LIBSTRINGS_OK`.
+    @param userdata A pointer that is passed to callback unchanged.
+    @returns A return code. If an error is returned, callback may have already been called for some strings.
+*/
+LIBSTRINGS unsigned int st_iterate(const char * const path, const char * const fallbackEncoding, st_iterate_callback callback, void * const userdata);
+
+/**
+    @brief Starts walking through a strings file.
+    @details Strings are visited in the same order and in the same way as st_iterate() visits them, one for each call to st_cursor_next().
+    @param ch A pointer to the cursor handle that is created by the function.
+    @param path A string containing the relative or absolute path to the strings file to be read. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_cursor_open(st_cursor_handle * const ch, const char * const path, const char * const fallbackEncoding);
+
+/**
+    @brief Gets the next string in the file being walked through.
+    @param ch The cursor handle the function acts on.
+    @param view The outputted string. Its data is valid until this function is next called on the cursor, or the cursor is closed. Once every string has been visited, this will be `NULL`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_cursor_next(st_cursor_handle ch, const st_string_view ** const view);
+
+/**
+    @brief Closes a cursor handle, unmapping its file.
+    @param ch The cursor handle to close.
+*/
+LIBSTRINGS void st_cursor_close(st_cursor_handle ch);
+
 ///@}
 
 
@@ -289,6 +755,72 @@ LIBSTRINGS unsigned int st_replace_string(st_strings_handle sh, const uint32_t s
 */
 LIBSTRINGS unsigned int st_remove_string(st_strings_handle sh, const uint32_t stringId);
 
+/**
+    @brief Adds, replaces and removes many strings in one call.
+    @details The edits are applied in the order given, so an edit may act on an ID added or removed by an earlier edit. All the edits are checked before any are applied: if any edit is invalid, no changes are made, and the function returns `LIBSTRINGS_ERROR_INVALID_ARGS`. An edit is invalid if it adds an ID that exists, replaces or removes an ID that doesn't exist, has an unrecognised operation, or adds or replaces a string with `NULL` data.
+    @param sh The handle the function acts on.
+    @param edits An array of the edits to make.
+    @param numEdits The size of the edits array.
+    @param statuses The outputted array of the return code for each edit, in the same order as edits. An edit that is valid has the code `LIBSTRINGS_OK`, even if the edits aren't applied because another edit is invalid. The array remains valid until this function is next called on the handle by the same thread. If numEdits is `0`, this will be `NULL`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_apply_edits(st_strings_handle sh, const st_string_edit * const edits, const size_t numEdits, const uint8_t ** const statuses);
+
+/**
+    @brief Copies strings from one handle into another.
+    @details Walks through the strings of src once, copying those chosen by the selector into dst, replacing any string with the same ID. The strings are copied, so src can be closed afterwards. If dst and src are the same handle, nothing is done.
+    @param dst The handle to copy strings into.
+    @param src The handle to copy strings from.
+    @param selector The selector that chooses which strings to copy.
+    @param flags Zero or more of the overlay flags, combined using bitwise OR.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_overlay(st_strings_handle dst, st_strings_handle src, const st_overlay_selector * const selector, const unsigned int flags);
+
+///@}
+
+
+/***************************************//**
+    @name Streaming Writer Functions
+    @brief Write a new strings file one string at a time, without holding all its strings in memory.
+*******************************************/
+///@{
+
+/**
+    @brief Starts writing a strings file.
+    @details String data is written to a temporary file in the same directory as the output file as strings are added. The output file itself isn't written until st_writer_finish() is called. Duplicate strings are only written once, as st_save() does.
+    @param wh A pointer to the writer handle that is created by the function.
+    @param path A string containing the relative or absolute path to the strings file to be written. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param encoding The encoding in which the strings should be written. Accepted values are `UTF-8`, `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_writer_open(st_writer_handle * const wh, const char * const path, const char * const encoding);
+
+/**
+    @brief Adds a string to the file being written.
+    @details If the string can't be encoded, or its ID has already been added, the function returns an error code and the writer can still be used. If writing to the temporary file fails, all further calls on the writer also fail.
+    @param wh The writer handle the function acts on.
+    @param stringId The ID of the string to be added. Must not already have been added.
+    @param str The string to be added, in UTF-8.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_writer_add(st_writer_handle wh, const uint32_t stringId, const char * const str);
+
+/**
+    @brief Writes the strings file.
+    @details Writes the strings added to the writer to its path. No more strings can be added once this has succeeded. The writer handle must still be closed using st_writer_close().
+    @param wh The writer handle the function acts on.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_writer_finish(st_writer_handle wh);
+
+/**
+    @brief Closes a writer handle.
+    @details Frees the memory used by the writer and deletes its temporary file. If st_writer_finish() hasn't succeeded, the strings file is not written.
+    @param wh The writer handle to close.
+*/
+LIBSTRINGS void st_writer_close(st_writer_handle wh);
+
 ///@}
 
 #ifdef __cplusplus
@@ -0,0 +1,200 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "search.h"
+#include "simd.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace libstrings {
+
+    /* Only two-byte sequences hold letters with case that fold to another
+       two-byte sequence, covering the alphabets of the languages the games
+       are localised into. Other characters are left as they are. */
+    void FoldCase(char * str, const size_t length) {
+        for (size_t i=0; i < length; i++) {
+            const uint8_t c = static_cast<uint8_t>(str[i]);
+            if (c >= 'A' && c <= 'Z') {
+                str[i] = char(c + ('a' - 'A'));
+                continue;
+            } else if (c < 0xC2 || c > 0xDF || i + 1 >= length || (static_cast<uint8_t>(str[i + 1]) & 0xC0) != 0x80)
+                continue;
+
+            const uint32_t codePoint = ((c & 0x1F) << 6) | (static_cast<uint8_t>(str[i + 1]) & 0x3F);
+            uint32_t folded = codePoint;
+            if (codePoint >= 0xC0 && codePoint <= 0xDE && codePoint != 0xD7)
+                folded = codePoint + 0x20;  //Latin-1 Supplement.
+            else if ((codePoint >= 0x100 && codePoint <= 0x12F) || (codePoint >= 0x132 && codePoint <= 0x137) || (codePoint >= 0x14A && codePoint <= 0x177)) {
+                if (codePoint % 2 == 0)
+                    folded = codePoint + 1;  //Latin Extended-A, capitals first.
+            } else if ((codePoint >= 0x139 && codePoint <= 0x148) || (codePoint >= 0x179 && codePoint <= 0x17E)) {
+                if (codePoint % 2 == 1)
+                    folded = codePoint + 1;
+            } else if (codePoint == 0x178)
+                folded = 0xFF;
+            else if (codePoint == 0x386)
+                folded = 0x3AC;  //Greek with tonos.
+            else if (codePoint >= 0x388 && codePoint <= 0x38A)
+                folded = codePoint + 0x25;
+            else if (codePoint == 0x38C)
+                folded = 0x3CC;
+            else if (codePoint == 0x38E || codePoint == 0x38F)
+                folded = codePoint + 0x3F;
+            else if (codePoint >= 0x391 && codePoint <= 0x3AB && codePoint != 0x3A2)
+                folded = codePoint + 0x20;  //Greek.
+            else if (codePoint == 0x3C2)
+                folded = 0x3C3;  //Final sigma.
+            else if (codePoint >= 0x400 && codePoint <= 0x40F)
+                folded = codePoint + 0x50;  //Cyrillic.
+            else if (codePoint >= 0x410 && codePoint <= 0x42F)
+                folded = codePoint + 0x20;
+
+            str[i] = char(0xC0 | (folded >> 6));
+            str[i + 1] = char(0x80 | (folded & 0x3F));
+            i++;
+        }
+    }
+
+    search_index::search_index() : bucketBits(0) {}
+
+    void search_index::Add(const uint32_t id, const char * str, const size_t length) {
+        ids.push_back(id);
+        starts.push_back(text.size());
+        text.append(str, length);
+        FoldCase(&text[starts.back()], length);
+        text.push_back('\0');
+    }
+
+    /* Count the strings in each bucket first, so that postings can be
+       allocated once and each bucket's strings written into their range,
+       which leaves them sorted. A string is only counted once per bucket. */
+    void search_index::Build() {
+        //Use about one bucket per sixteen bytes, which keeps the tables used while building small enough to cache.
+        bucketBits = 10;
+        while (bucketBits < 22 && (size_t(1) << bucketBits) < text.size() / 16)
+            bucketBits++;
+        const size_t numBuckets = size_t(1) << bucketBits;
+
+        vector<uint32_t> lastString(numBuckets, 0);  //One more than the index of the last string put in each bucket.
+        offsets.assign(numBuckets + 1, 0);
+        for (size_t i=0; i < ids.size(); i++) {
+            const char * str = text.data() + starts[i];
+            const size_t length = Length(i);
+            for (size_t j=0; j + 3 <= length; j++) {
+                const uint32_t bucket = Bucket(str + j);
+                if (lastString[bucket] != i + 1) {
+                    lastString[bucket] = uint32_t(i + 1);
+                    offsets[bucket + 1]++;
+                }
+            }
+        }
+
+        for (size_t i=0; i < numBuckets; i++)
+            offsets[i + 1] += offsets[i];
+        postings.resize(offsets[numBuckets]);
+
+        vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+        lastString.assign(numBuckets, 0);
+        for (size_t i=0; i < ids.size(); i++) {
+            const char * str = text.data() + starts[i];
+            const size_t length = Length(i);
+            for (size_t j=0; j + 3 <= length; j++) {
+                const uint32_t bucket = Bucket(str + j);
+                if (lastString[bucket] != i + 1) {
+                    lastString[bucket] = uint32_t(i + 1);
+                    postings[next[bucket]++] = uint32_t(i);
+                }
+            }
+        }
+    }
+
+    /* Intersect the postings of the query's trigrams, starting with the
+       shortest list, then check each remaining string for the query. */
+    void search_index::Find(const char * query, const size_t length, vector<uint32_t>& out) const {
+        out.clear();
+        if (length == 0) {
+            out = ids;
+            return;
+        }
+
+        string folded(query, length);
+        FoldCase(&folded[0], length);
+        pattern_matcher matcher;
+        matcher.AddSubstring(folded.data(), length);
+
+        if (length < 3) {
+            for (size_t i=0; i < ids.size(); i++) {
+                if (matcher.Matches(text.data() + starts[i], Length(i)))
+                    out.push_back(ids[i]);
+            }
+            return;
+        }
+
+        vector<uint32_t> buckets;
+        for (size_t i=0; i + 3 <= length; i++)
+            buckets.push_back(Bucket(folded.data() + i));
+        sort(buckets.begin(), buckets.end());
+        buckets.erase(unique(buckets.begin(), buckets.end()), buckets.end());
+
+        //Each bucket's size and start, so that sorting puts the shortest list first.
+        vector< pair<uint32_t, uint32_t> > ranges;
+        for (size_t i=0; i < buckets.size(); i++) {
+            const uint32_t count = offsets[buckets[i] + 1] - offsets[buckets[i]];
+            if (count == 0)
+                return;
+            ranges.push_back(pair<uint32_t, uint32_t>(count, offsets[buckets[i]]));
+        }
+        sort(ranges.begin(), ranges.end());
+
+        vector<uint32_t> candidates(postings.begin() + ranges[0].second, postings.begin() + ranges[0].second + ranges[0].first);
+        for (size_t i=1; i < ranges.size() && !candidates.empty(); i++) {
+            const uint32_t * listIt = &postings[0] + ranges[i].second;
+            const uint32_t * const listEnd = listIt + ranges[i].first;
+            size_t kept = 0;
+            for (size_t j=0; j < candidates.size() && listIt != listEnd; j++) {
+                listIt = lower_bound(listIt, listEnd, candidates[j]);
+                if (listIt != listEnd && *listIt == candidates[j])
+                    candidates[kept++] = candidates[j];
+            }
+            candidates.resize(kept);
+        }
+
+        for (size_t i=0; i < candidates.size(); i++) {
+            if (matcher.Matches(text.data() + starts[candidates[i]], Length(candidates[i])))
+                out.push_back(ids[candidates[i]]);
+        }
+    }
+
+    size_t search_index::Length(const size_t index) const {
+        const size_t end = index + 1 < starts.size() ? starts[index + 1] : text.size();
+        return end - starts[index] - 1;
+    }
+
+    uint32_t search_index::Bucket(const char * str) const {
+        const uint8_t * bytes = reinterpret_cast<const uint8_t*>(str);
+        const uint32_t trigram = (uint32_t(bytes[0]) << 16) | (uint32_t(bytes[1]) << 8) | bytes[2];
+        return (trigram * 0x9E3779B1u) >> (32 - bucketBits);
+    }
+}
@@ -0,0 +1,71 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_SEARCH_H__
+#define __LIBSTRINGS_SEARCH_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace libstrings {
+
+    //Lowercases the Latin, Greek and Cyrillic capital letters in a UTF-8 string, which doesn't change its length.
+    void FoldCase(char * str, const size_t length);
+
+    /* An inverted index of the three-byte sequences in a set of strings,
+       which are held case-folded. Each sequence is hashed into one of a
+       fixed number of buckets, which hold the strings containing any of
+       their sequences. A substring search looks up the strings in the
+       buckets of every three-byte sequence in the query, and only checks
+       those for the query itself. Queries shorter than three bytes scan all
+       the strings instead. */
+    class search_index {
+    public:
+        search_index();
+
+        //Strings must be added in ascending order of ID, and before Build() is called.
+        void Add(const uint32_t id, const char * str, const size_t length);
+        void Build();
+
+        //Outputs the IDs of the strings containing the query, ignoring case, in ascending order.
+        void Find(const char * query, const size_t length, std::vector<uint32_t>& ids) const;
+    private:
+        std::vector<uint32_t> ids;
+        std::string text;               //The folded strings, each followed by a null.
+        std::vector<size_t> starts;     //Where each string starts in text.
+
+        /* The indices of the strings in each bucket are postings[offsets[b]]
+           up to postings[offsets[b + 1]], in ascending order. There are fewer
+           postings than bytes in a strings file's data block, so they fit in
+           32 bits. */
+        unsigned int bucketBits;
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> postings;
+
+        size_t Length(const size_t index) const;
+        uint32_t Bucket(const char * str) const;  //Of the three bytes at str.
+    };
+}
+
+#endif
@@ -0,0 +1,624 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "simd.h"
+
+#include <stdint.h>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#   define LIBSTRINGS_X86
+#   include <immintrin.h>
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#   endif
+#endif
+
+// GCC and Clang need to be told which functions may use which instructions.
+#if defined(__GNUC__)
+#   define LIBSTRINGS_TARGET(x) __attribute__((target(x)))
+#else
+#   define LIBSTRINGS_TARGET(x)
+#endif
+
+namespace libstrings {
+
+    /*------------------------------
+       CPU Feature Detection
+    ------------------------------*/
+
+    enum simd_level {
+        SIMD_NONE,
+        SIMD_SSE42,
+        SIMD_AVX2
+    };
+
+    static simd_level DetectSIMDLevel() {
+#if defined(LIBSTRINGS_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        const bool sse42 = (info[2] & (1 << 20)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!sse42)
+            return SIMD_NONE;
+
+        //AVX2 also needs the OS to save the YMM registers.
+        if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))
+                return SIMD_AVX2;
+        }
+        return SIMD_SSE42;
+#elif defined(LIBSTRINGS_X86) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return SIMD_AVX2;
+        if (__builtin_cpu_supports("sse4.2"))
+            return SIMD_SSE42;
+        return SIMD_NONE;
+#else
+        return SIMD_NONE;
+#endif
+    }
+
+    /* Detected when the library is loaded, as function-local statics aren't
+       initialised thread-safely by all the supported compilers. Anything
+       run before then sees SIMD_NONE and uses the scalar code. */
+    static const simd_level simdLevel = DetectSIMDLevel();
+
+    static simd_level GetSIMDLevel() {
+        return simdLevel;
+    }
+
+    static unsigned int CountTrailingZeros(const uint32_t mask) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+
+    /*------------------------------
+       UTF-8 Validation
+    ------------------------------*/
+
+    static bool IsValidUTF8Scalar(const uint8_t * str, const size_t length) {
+        size_t i = 0;
+        while (i < length) {
+            //Skip ASCII eight bytes at a time.
+            if (i + 8 <= length) {
+                uint64_t block;
+                memcpy(&block, str + i, sizeof(block));
+                if ((block & 0x8080808080808080ULL) == 0) {
+                    i += 8;
+                    continue;
+                }
+            }
+
+            const uint8_t c = str[i];
+            if (c < 0x80) {
+                i++;
+                continue;
+            }
+
+            size_t extra;
+            uint32_t codePoint;
+            if (c >= 0xC2 && c <= 0xDF) {
+                extra = 1;
+                codePoint = c & 0x1F;
+            } else if (c >= 0xE0 && c <= 0xEF) {
+                extra = 2;
+                codePoint = c & 0x0F;
+            } else if (c >= 0xF0 && c <= 0xF4) {
+                extra = 3;
+                codePoint = c & 0x07;
+            } else
+                return false;
+
+            if (i + extra >= length)
+                return false;
+
+            for (size_t j = 1; j <= extra; j++) {
+                if ((str[i + j] & 0xC0) != 0x80)
+                    return false;
+                codePoint = (codePoint << 6) | (str[i + j] & 0x3F);
+            }
+
+            //Reject overlong encodings, surrogates and values past U+10FFFF.
+            if ((extra == 2 && codePoint < 0x800)
+                || (extra == 3 && (codePoint < 0x10000 || codePoint > 0x10FFFF))
+                || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+                return false;
+
+            i += extra + 1;
+        }
+        return true;
+    }
+
+#ifdef LIBSTRINGS_X86
+    /* The vectorised validators classify each byte by looking up the high
+       and low nibbles of the previous byte and the high nibble of the
+       current byte, then checking that continuation bytes appear exactly
+       where lead bytes require them. See Keiser and Lemire, "Validating
+       UTF-8 In Less Than One Instruction Per Byte" (2021). */
+    const uint8_t TOO_SHORT      = 1 << 0;
+    const uint8_t TOO_LONG       = 1 << 1;
+    const uint8_t OVERLONG_3     = 1 << 2;
+    const uint8_t TOO_LARGE      = 1 << 3;
+    const uint8_t SURROGATE      = 1 << 4;
+    const uint8_t OVERLONG_2     = 1 << 5;
+    const uint8_t TOO_LARGE_1000 = 1 << 6;
+    const uint8_t OVERLONG_4     = 1 << 6;
+    const uint8_t TWO_CONTS      = 1 << 7;
+    const uint8_t CARRY          = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    static const uint8_t byte1High[16] = {
+        //0_______: ASCII.
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        //10______: continuation.
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        //1100____, 1101____: two-byte lead.
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        //1110____: three-byte lead.
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        //1111____: four-byte lead.
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+    };
+
+    static const uint8_t byte1Low[16] = {
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000
+    };
+
+    static const uint8_t byte2High[16] = {
+        //________ 0_______: ASCII.
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        //________ 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        //________ 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        //________ 101_____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        //________ 11______: lead byte.
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+    };
+
+    //Bytes that, at the end of a block, start a sequence running past it.
+    static const uint8_t incompleteMax[32] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF
+    };
+
+    LIBSTRINGS_TARGET("sse4.2")
+    static __m128i CheckBlockSSE42(const __m128i input, const __m128i prevInput) {
+        const __m128i lowNibble = _mm_set1_epi8(0x0F);
+        const __m128i prev1 = _mm_alignr_epi8(input, prevInput, 15);
+        const __m128i prev2 = _mm_alignr_epi8(input, prevInput, 14);
+        const __m128i prev3 = _mm_alignr_epi8(input, prevInput, 13);
+
+        const __m128i b1h = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)byte1High), _mm_and_si128(_mm_srli_epi16(prev1, 4), lowNibble));
+        const __m128i b1l = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)byte1Low), _mm_and_si128(prev1, lowNibble));
+        const __m128i b2h = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)byte2High), _mm_and_si128(_mm_srli_epi16(input, 4), lowNibble));
+        const __m128i special = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+
+        //Third and fourth bytes of a sequence must be continuations.
+        const __m128i isThird = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+        const __m128i isFourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));
+        const __m128i must23 = _mm_and_si128(_mm_or_si128(isThird, isFourth), _mm_set1_epi8((char)0x80));
+
+        return _mm_xor_si128(must23, special);
+    }
+
+    LIBSTRINGS_TARGET("sse4.2")
+    static bool IsValidUTF8SSE42(const uint8_t * str, const size_t length) {
+        const __m128i maxValue = _mm_loadu_si128((const __m128i*)(incompleteMax + 16));
+        __m128i error = _mm_setzero_si128();
+        __m128i prevInput = _mm_setzero_si128();
+        __m128i prevIncomplete = _mm_setzero_si128();
+
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            const __m128i input = _mm_loadu_si128((const __m128i*)(str + i));
+            if (_mm_movemask_epi8(input) == 0)
+                error = _mm_or_si128(error, prevIncomplete);
+            else {
+                error = _mm_or_si128(error, CheckBlockSSE42(input, prevInput));
+                prevIncomplete = _mm_subs_epu8(input, maxValue);
+            }
+            prevInput = input;
+        }
+
+        //Pad the tail with nulls, which are ASCII.
+        if (i < length) {
+            uint8_t tail[16] = {0};
+            memcpy(tail, str + i, length - i);
+            const __m128i input = _mm_loadu_si128((const __m128i*)tail);
+            error = _mm_or_si128(error, CheckBlockSSE42(input, prevInput));
+            prevIncomplete = _mm_subs_epu8(input, maxValue);
+        }
+        error = _mm_or_si128(error, prevIncomplete);
+
+        return _mm_testz_si128(error, error) != 0;
+    }
+
+    LIBSTRINGS_TARGET("avx2")
+    static __m256i CheckBlockAVX2(const __m256i input, const __m256i prevInput) {
+        const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+        //The high lane of prevInput followed by the low lane of input.
+        const __m256i shifted = _mm256_permute2x128_si256(prevInput, input, 0x21);
+        const __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        const __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+        const __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+        const __m256i b1h = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte1High)), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble));
+        const __m256i b1l = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte1Low)), _mm256_and_si256(prev1, lowNibble));
+        const __m256i b2h = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)byte2High)), _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble));
+        const __m256i special = _mm256_and_si256(_mm256_and_si256(b1h, b1l), b2h);
+
+        const __m256i isThird = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+        const __m256i isFourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+        const __m256i must23 = _mm256_and_si256(_mm256_or_si256(isThird, isFourth), _mm256_set1_epi8((char)0x80));
+
+        return _mm256_xor_si256(must23, special);
+    }
+
+    LIBSTRINGS_TARGET("avx2")
+    static bool IsValidUTF8AVX2(const uint8_t * str, const size_t length) {
+        const __m256i maxValue = _mm256_loadu_si256((const __m256i*)incompleteMax);
+        __m256i error = _mm256_setzero_si256();
+        __m256i prevInput = _mm256_setzero_si256();
+        __m256i prevIncomplete = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            const __m256i input = _mm256_loadu_si256((const __m256i*)(str + i));
+            if (_mm256_movemask_epi8(input) == 0)
+                error = _mm256_or_si256(error, prevIncomplete);
+            else {
+                error = _mm256_or_si256(error, CheckBlockAVX2(input, prevInput));
+                prevIncomplete = _mm256_subs_epu8(input, maxValue);
+            }
+            prevInput = input;
+        }
+
+        if (i < length) {
+            uint8_t tail[32] = {0};
+            memcpy(tail, str + i, length - i);
+            const __m256i input = _mm256_loadu_si256((const __m256i*)tail);
+            error = _mm256_or_si256(error, CheckBlockAVX2(input, prevInput));
+            prevIncomplete = _mm256_subs_epu8(input, maxValue);
+        }
+        error = _mm256_or_si256(error, prevIncomplete);
+
+        return _mm256_testz_si256(error, error) != 0;
+    }
+#endif
+
+    bool IsValidUTF8(const char * str, const size_t length) {
+        const uint8_t * bytes = reinterpret_cast<const uint8_t*>(str);
+
+#ifdef LIBSTRINGS_X86
+        //Short strings aren't worth the setup cost.
+        if (length >= 16) {
+            switch (GetSIMDLevel()) {
+            case SIMD_AVX2:
+                return IsValidUTF8AVX2(bytes, length);
+            case SIMD_SSE42:
+                return IsValidUTF8SSE42(bytes, length);
+            default:
+                break;
+            }
+        }
+#endif
+        return IsValidUTF8Scalar(bytes, length);
+    }
+
+
+    /*------------------------------
+       ASCII Copying
+    ------------------------------*/
+
+    static size_t CopyASCIIScalar(const char * src, const size_t length, char * dst) {
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            uint64_t block;
+            memcpy(&block, src + i, sizeof(block));
+            if (block & 0x8080808080808080ULL)
+                break;
+            memcpy(dst + i, &block, sizeof(block));
+        }
+        while (i < length && static_cast<uint8_t>(src[i]) < 0x80) {
+            dst[i] = src[i];
+            i++;
+        }
+        return i;
+    }
+
+#ifdef LIBSTRINGS_X86
+    LIBSTRINGS_TARGET("sse4.2")
+    static size_t CopyASCIISSE42(const char * src, const size_t length, char * dst) {
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            const __m128i block = _mm_loadu_si128((const __m128i*)(src + i));
+            const uint32_t mask = _mm_movemask_epi8(block);
+            if (mask != 0) {
+                const size_t run = CountTrailingZeros(mask);
+                memcpy(dst + i, src + i, run);
+                return i + run;
+            }
+            _mm_storeu_si128((__m128i*)(dst + i), block);
+        }
+        return i + CopyASCIIScalar(src + i, length - i, dst + i);
+    }
+
+    LIBSTRINGS_TARGET("avx2")
+    static size_t CopyASCIIAVX2(const char * src, const size_t length, char * dst) {
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            const __m256i block = _mm256_loadu_si256((const __m256i*)(src + i));
+            const uint32_t mask = _mm256_movemask_epi8(block);
+            if (mask != 0) {
+                const size_t run = CountTrailingZeros(mask);
+                memcpy(dst + i, src + i, run);
+                return i + run;
+            }
+            _mm256_storeu_si256((__m256i*)(dst + i), block);
+        }
+        return i + CopyASCIIScalar(src + i, length - i, dst + i);
+    }
+#endif
+
+    size_t CopyASCII(const char * src, const size_t length, char * dst) {
+#ifdef LIBSTRINGS_X86
+        if (length >= 16) {
+            switch (GetSIMDLevel()) {
+            case SIMD_AVX2:
+                return CopyASCIIAVX2(src, length, dst);
+            case SIMD_SSE42:
+                return CopyASCIISSE42(src, length, dst);
+            default:
+                break;
+            }
+        }
+#endif
+        return CopyASCIIScalar(src, length, dst);
+    }
+
+
+    /*------------------------------
+       Pattern Matching
+    ------------------------------*/
+
+    /* Each of the functions below finds the first position at or after pos
+       where a pattern in some bucket may start, outputting the buckets. The
+       byte after the end of the string is looked up as a null, which only
+       patterns one byte long accept. */
+
+    static size_t NextCandidateScalar(const uint8_t (&tables)[4][16], const uint8_t * str, const size_t length, size_t pos, uint8_t& candidates) {
+        for (; pos < length; pos++) {
+            const uint8_t first = str[pos];
+            const uint8_t second = pos + 1 < length ? str[pos + 1] : 0;
+            candidates = tables[0][first & 0x0F] & tables[1][first >> 4] & tables[2][second & 0x0F] & tables[3][second >> 4];
+            if (candidates != 0)
+                return pos;
+        }
+        return length;
+    }
+
+#ifdef LIBSTRINGS_X86
+    LIBSTRINGS_TARGET("sse4.2")
+    static size_t NextCandidateSSE42(const uint8_t (&tables)[4][16], const uint8_t * str, const size_t length, size_t pos, uint8_t& candidates) {
+        const __m128i lowNibble = _mm_set1_epi8(0x0F);
+        const __m128i firstLow = _mm_loadu_si128((const __m128i*)tables[0]);
+        const __m128i firstHigh = _mm_loadu_si128((const __m128i*)tables[1]);
+        const __m128i secondLow = _mm_loadu_si128((const __m128i*)tables[2]);
+        const __m128i secondHigh = _mm_loadu_si128((const __m128i*)tables[3]);
+
+        //Each block also reads the byte after it.
+        for (; pos + 17 <= length; pos += 16) {
+            const __m128i first = _mm_loadu_si128((const __m128i*)(str + pos));
+            const __m128i second = _mm_loadu_si128((const __m128i*)(str + pos + 1));
+
+            __m128i buckets = _mm_and_si128(_mm_shuffle_epi8(firstLow, _mm_and_si128(first, lowNibble)),
+                                            _mm_shuffle_epi8(firstHigh, _mm_and_si128(_mm_srli_epi16(first, 4), lowNibble)));
+            buckets = _mm_and_si128(buckets, _mm_shuffle_epi8(secondLow, _mm_and_si128(second, lowNibble)));
+            buckets = _mm_and_si128(buckets, _mm_shuffle_epi8(secondHigh, _mm_and_si128(_mm_srli_epi16(second, 4), lowNibble)));
+
+            const uint32_t mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(buckets, _mm_setzero_si128())) & 0xFFFF;
+            if (mask != 0) {
+                uint8_t blockBuckets[16];
+                _mm_storeu_si128((__m128i*)blockBuckets, buckets);
+                const unsigned int offset = CountTrailingZeros(mask);
+                candidates = blockBuckets[offset];
+                return pos + offset;
+            }
+        }
+        return NextCandidateScalar(tables, str, length, pos, candidates);
+    }
+
+    LIBSTRINGS_TARGET("avx2")
+    static size_t NextCandidateAVX2(const uint8_t (&tables)[4][16], const uint8_t * str, const size_t length, size_t pos, uint8_t& candidates) {
+        //The shuffles look up each 128-bit lane separately, so both lanes hold the tables.
+        const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+        const __m256i firstLow = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[0]));
+        const __m256i firstHigh = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[1]));
+        const __m256i secondLow = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[2]));
+        const __m256i secondHigh = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[3]));
+
+        for (; pos + 33 <= length; pos += 32) {
+            const __m256i first = _mm256_loadu_si256((const __m256i*)(str + pos));
+            const __m256i second = _mm256_loadu_si256((const __m256i*)(str + pos + 1));
+
+            __m256i buckets = _mm256_and_si256(_mm256_shuffle_epi8(firstLow, _mm256_and_si256(first, lowNibble)),
+                                               _mm256_shuffle_epi8(firstHigh, _mm256_and_si256(_mm256_srli_epi16(first, 4), lowNibble)));
+            buckets = _mm256_and_si256(buckets, _mm256_shuffle_epi8(secondLow, _mm256_and_si256(second, lowNibble)));
+            buckets = _mm256_and_si256(buckets, _mm256_shuffle_epi8(secondHigh, _mm256_and_si256(_mm256_srli_epi16(second, 4), lowNibble)));
+
+            const uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(buckets, _mm256_setzero_si256()));
+            if (mask != 0) {
+                uint8_t blockBuckets[32];
+                _mm256_storeu_si256((__m256i*)blockBuckets, buckets);
+                const unsigned int offset = CountTrailingZeros(mask);
+                candidates = blockBuckets[offset];
+                return pos + offset;
+            }
+        }
+        return NextCandidateSSE42(tables, str, length, pos, candidates);
+    }
+#endif
+
+    static size_t NextCandidate(const uint8_t (&tables)[4][16], const uint8_t * str, const size_t length, const size_t pos, uint8_t& candidates) {
+#ifdef LIBSTRINGS_X86
+        if (length - pos >= 17) {
+            switch (GetSIMDLevel()) {
+            case SIMD_AVX2:
+                return NextCandidateAVX2(tables, str, length, pos, candidates);
+            case SIMD_SSE42:
+                return NextCandidateSSE42(tables, str, length, pos, candidates);
+            default:
+                break;
+            }
+        }
+#endif
+        return NextCandidateScalar(tables, str, length, pos, candidates);
+    }
+
+    pattern_matcher::pattern_matcher() : matchesAll(false) {
+        memset(tables, 0, sizeof(tables));
+    }
+
+    void pattern_matcher::AddPrefix(const char * pattern, const size_t length) {
+        if (length == 0)
+            matchesAll = true;
+        else
+            prefixes.push_back(std::string(pattern, length));
+    }
+
+    /* Patterns sharing their first two bytes go in the same bucket, so that
+       a position matching them only has to be checked against that bucket. */
+    void pattern_matcher::AddSubstring(const char * pattern, const size_t length) {
+        if (length == 0) {
+            matchesAll = true;
+            return;
+        }
+
+        const size_t fingerprintLength = length < 2 ? length : 2;
+        size_t bucket = 8;
+        for (size_t b=0; b < 8 && bucket == 8; b++) {
+            for (size_t i=0; i < buckets[b].size(); i++) {
+                if (substrings[buckets[b][i]].compare(0, 2, pattern, fingerprintLength) == 0) {
+                    bucket = b;
+                    break;
+                }
+            }
+        }
+
+        //Otherwise use the bucket with the fewest patterns.
+        if (bucket == 8) {
+            bucket = 0;
+            for (size_t b=1; b < 8; b++) {
+                if (buckets[b].size() < buckets[bucket].size())
+                    bucket = b;
+            }
+        }
+
+        substrings.push_back(std::string(pattern, length));
+        buckets[bucket].push_back(substrings.size() - 1);
+
+        const uint8_t bit = uint8_t(1 << bucket);
+        const uint8_t first = static_cast<uint8_t>(pattern[0]);
+        tables[0][first & 0x0F] |= bit;
+        tables[1][first >> 4] |= bit;
+        if (length > 1) {
+            const uint8_t second = static_cast<uint8_t>(pattern[1]);
+            tables[2][second & 0x0F] |= bit;
+            tables[3][second >> 4] |= bit;
+        } else {
+            for (size_t i=0; i < 16; i++) {
+                tables[2][i] |= bit;
+                tables[3][i] |= bit;
+            }
+        }
+    }
+
+    bool pattern_matcher::MatchesAt(const char * str, const size_t length, const size_t pos, const uint8_t candidates) const {
+        for (size_t bucket=0; bucket < 8; bucket++) {
+            if ((candidates & (1 << bucket)) == 0)
+                continue;
+            for (size_t i=0; i < buckets[bucket].size(); i++) {
+                const std::string& pattern = substrings[buckets[bucket][i]];
+                if (pattern.length() <= length - pos && memcmp(str + pos, pattern.data(), pattern.length()) == 0)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool pattern_matcher::Matches(const char * str, const size_t length) const {
+        if (matchesAll)
+            return true;
+
+        for (size_t i=0; i < prefixes.size(); i++) {
+            if (prefixes[i].length() <= length && memcmp(str, prefixes[i].data(), prefixes[i].length()) == 0)
+                return true;
+        }
+
+        if (substrings.empty())
+            return false;
+
+        const uint8_t * bytes = reinterpret_cast<const uint8_t*>(str);
+        size_t pos = 0;
+        while (pos < length) {
+            uint8_t candidates;
+            pos = NextCandidate(tables, bytes, length, pos, candidates);
+            if (pos == length)
+                break;
+            if (MatchesAt(str, length, pos, candidates))
+                return true;
+            pos++;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,85 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_SIMD_H__
+#define __LIBSTRINGS_SIMD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#   include <xmmintrin.h>
+#endif
+
+// Hints that the memory at p will be read soon.
+#if defined(__GNUC__)
+#   define LIBSTRINGS_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER)
+#   define LIBSTRINGS_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char*>(p), _MM_HINT_T0)
+#else
+#   define LIBSTRINGS_PREFETCH(p)
+#endif
+
+/* Vectorised routines for scanning string data. Each one checks at runtime
+   which instruction sets the CPU supports and uses the widest available,
+   falling back to portable scalar code on other CPUs. */
+namespace libstrings {
+    // Checks whether the given bytes form a valid UTF-8 string.
+    bool IsValidUTF8(const char * str, const size_t length);
+
+    // Copies the run of ASCII bytes at the start of src to dst, returning its length.
+    size_t CopyASCII(const char * src, const size_t length, char * dst);
+
+    /* Matches strings against a set of patterns, each of which must either
+       start the string or appear anywhere in it. The patterns that can
+       appear anywhere are all looked for in a single pass: each is put in
+       one of eight buckets, and the first two bytes of every position in
+       the string are looked up in tables of which buckets have patterns
+       starting with those bytes, a block at a time. Only the patterns in the
+       buckets found are then compared in full. */
+    class pattern_matcher {
+    public:
+        pattern_matcher();
+
+        void AddPrefix(const char * pattern, const size_t length);
+        void AddSubstring(const char * pattern, const size_t length);
+
+        bool Matches(const char * str, const size_t length) const;
+    private:
+        std::vector<std::string> prefixes;
+        std::vector<std::string> substrings;
+        std::vector<size_t> buckets[8];     //Indices into substrings.
+        bool matchesAll;                    //Set if an empty pattern was added.
+
+        /* Bitmasks of the buckets with patterns that can start with a byte,
+           indexed by the low then the high nibble of a position's first
+           byte, then of its second byte. */
+        uint8_t tables[4][16];
+
+        bool MatchesAt(const char * str, const size_t length, const size_t pos, const uint8_t candidates) const;
+    };
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "snapshot.h"
+#include "libstrings.h"
+#include "error.h"
+#include "helpers.h"
+#include "streams.h"
+#include <cstring>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+namespace fs = boost::filesystem;
+
+namespace libstrings {
+
+    const char snapshotMagic[8] = { 'S', 'T', 'S', 'N', 'A', 'P', '\r', '\n' };
+    const uint32_t snapshotVersion = 2;
+
+    uint64_t HashSourceDirectory(const string& path, const uint32_t count) {
+        vector<char> directory(2 * sizeof(uint32_t) * (size_t(count) + 1));
+        try {
+            libstrings::ifstream in(fs::path(path), ios::binary);
+            in.exceptions(ios::failbit | ios::badbit | ios::eofbit);
+            in.read(&directory[0], directory.size());
+        } catch (ios_base::failure& e) {
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
+        }
+        return HashBytes(&directory[0], directory.size());
+    }
+
+    /* Only the directory is checked, so that none of the strings need to be
+       read. Each string must lie within the strings, and the strings must
+       end with a terminator, so that nothing is read past the mapping even
+       if a string's own terminator is missing. The IDs must be ascending,
+       as they're searched. */
+    snapshot_file::snapshot_file(const string& path, const string& sourcePath) : path(path) {
+        try {
+            if (!fs::exists(path) || fs::file_size(path) < sizeof(snapshot_header))
+                throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "\"" + path + "\" is not a snapshot.");
+            mapping.open(path);
+        } catch (ios_base::failure& e) {
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not map \"" + path + "\": " + e.what());
+        } catch (fs::filesystem_error& e) {
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what());
+        }
+
+        const snapshot_header& header = Header();
+        if (memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) != 0 || header.version != snapshotVersion)
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "\"" + path + "\" is not a snapshot.");
+        else if (header.stringsSize > mapping.size() || mapping.size() != sizeof(snapshot_header) + uint64_t(header.count) * sizeof(snapshot_entry) + header.stringsSize)
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "\"" + path + "\" is truncated or corrupt.");
+        else if (header.stringsSize > 0 && Strings()[header.stringsSize - 1] != '\0')
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "\"" + path + "\" is truncated or corrupt.");
+
+        const snapshot_entry * entries = Entries();
+        for (uint32_t i=0; i < header.count; i++) {
+            if (entries[i].offset >= header.stringsSize || entries[i].length >= header.stringsSize - entries[i].offset
+                || (i > 0 && entries[i].id <= entries[i - 1].id))
+                throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "\"" + path + "\" is truncated or corrupt.");
+        }
+
+        //The size and time are checked first, as they don't need the file to be read.
+        try {
+            if (!fs::exists(sourcePath) || fs::file_size(sourcePath) != header.sourceSize || fs::last_write_time(sourcePath) != header.sourceTime
+                || 2 * sizeof(uint32_t) * (uint64_t(header.sourceCount) + 1) > header.sourceSize || HashSourceDirectory(sourcePath, header.sourceCount) != header.sourceHash)
+                throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "\"" + sourcePath + "\" has changed since \"" + path + "\" was saved.");
+        } catch (fs::filesystem_error& e) {
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what());
+        }
+    }
+
+    const boost::iostreams::mapped_file_source& snapshot_file::Mapping() const {
+        return mapping;
+    }
+
+    const snapshot_header& snapshot_file::Header() const {
+        return *reinterpret_cast<const snapshot_header *>(mapping.data());
+    }
+
+    const snapshot_entry * snapshot_file::Entries() const {
+        return reinterpret_cast<const snapshot_entry *>(mapping.data() + sizeof(snapshot_header));
+    }
+
+    const char * snapshot_file::Strings() const {
+        return mapping.data() + sizeof(snapshot_header) + size_t(Header().count) * sizeof(snapshot_entry);
+    }
+}
@@ -0,0 +1,86 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_SNAPSHOT_H__
+#define __LIBSTRINGS_SNAPSHOT_H__
+
+#include <stdint.h>
+#include <string>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace libstrings {
+
+    /* A snapshot holds a handle's strings as UTF-8, laid out so that they
+       can be used straight from a mapping of the file. A header is followed
+       by a directory of entries sorted by ID, then by the strings, each
+       null-terminated. Everything is in native byte order. The header also
+       records the size and modification time of the strings file the
+       strings were read from, and a hash of its header and directory, and
+       a snapshot isn't used if any of them differ. The file's data block
+       isn't hashed, as that would mean reading it, so a change to its
+       strings that keeps all three the same isn't noticed. */
+    struct snapshot_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;             //Number of entries.
+        uint64_t stringsSize;       //Size of the strings after the directory.
+
+        //The strings file, as it was when the snapshot was saved.
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t sourceHash;        //Of the header and directory.
+        uint64_t sourceDataSize;    //Size of the data block when last fully written.
+        uint32_t sourceCount;
+        char sourceEncoding[20];    //Null-terminated, or empty if the name is too long.
+    };
+
+    struct snapshot_entry {
+        uint32_t id;
+        uint32_t length;            //Excludes the null terminator.
+        uint64_t offset;            //From the start of the strings.
+        uint64_t hash;              //HashBytes() of the string.
+    };
+
+    extern const char snapshotMagic[8];
+    extern const uint32_t snapshotVersion;
+
+    //Hashes the header and directory of a strings file with count entries.
+    uint64_t HashSourceDirectory(const std::string& path, const uint32_t count);
+
+    /* Maps the snapshot at path, checking that it is complete and that the
+       strings file at sourcePath hasn't changed since it was saved. */
+    class snapshot_file {
+    public:
+        snapshot_file(const std::string& path, const std::string& sourcePath);
+
+        const std::string path;
+        const boost::iostreams::mapped_file_source& Mapping() const;
+        const snapshot_header& Header() const;
+        const snapshot_entry * Entries() const;
+        const char * Strings() const;
+    private:
+        boost::iostreams::mapped_file_source mapping;
+    };
+}
+
+#endif
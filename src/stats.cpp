@@ -0,0 +1,141 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "stats.h"
+
+#if defined(_WIN32)
+#   include <windows.h>
+#else
+#   include <time.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define LIBSTRINGS_HAS_TSC
+#elif defined(_M_X64) || defined(_M_IX86)
+#   include <intrin.h>
+#   define LIBSTRINGS_HAS_TSC
+#endif
+
+namespace libstrings {
+
+#ifndef LIBSTRINGS_NO_STATS
+    namespace {
+        //Nanoseconds from the system's monotonic clock.
+        uint64_t ClockNanoseconds() {
+#if defined(_WIN32)
+            LARGE_INTEGER count, frequency;
+            QueryPerformanceCounter(&count);
+            QueryPerformanceFrequency(&frequency);
+            return uint64_t(double(count.QuadPart) * 1e9 / double(frequency.QuadPart));
+#else
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+        }
+
+        /* Ticks are converted using their rate since the library was
+           loaded, which becomes exact as the run goes on. */
+        struct tick_epoch {
+            tick_epoch() : ticks(Ticks()), nanoseconds(ClockNanoseconds()) {}
+
+            const uint64_t ticks;
+            const uint64_t nanoseconds;
+
+            double NanosecondsPerTick() const {
+                const uint64_t elapsedTicks = Ticks() - ticks;
+                const uint64_t elapsedNanoseconds = ClockNanoseconds() - nanoseconds;
+                return elapsedTicks == 0 ? 1.0 : double(elapsedNanoseconds) / double(elapsedTicks);
+            }
+        };
+
+        const tick_epoch epoch;
+    }
+
+    uint64_t Ticks() {
+#ifdef LIBSTRINGS_HAS_TSC
+        return __rdtsc();
+#else
+        return ClockNanoseconds();
+#endif
+    }
+
+    stats::stats(stats * parent) : parent(parent) {
+        for (size_t i=0; i < STAT_COUNT; i++)
+            values[i].store(0, boost::memory_order_relaxed);
+    }
+
+    void stats::Add(const stat_id id, const uint64_t value) {
+        if (value == 0)
+            return;
+
+        values[id].fetch_add(value, boost::memory_order_relaxed);
+        if (parent != NULL)
+            parent->Add(id, value);
+    }
+
+    void stats::Get(st_stats& out) const {
+        out.bytesRead = values[STAT_BYTES_READ].load(boost::memory_order_relaxed);
+        out.bytesWritten = values[STAT_BYTES_WRITTEN].load(boost::memory_order_relaxed);
+        out.stringsDecoded = values[STAT_STRINGS_DECODED].load(boost::memory_order_relaxed);
+        out.stringsTranscoded = values[STAT_STRINGS_TRANSCODED].load(boost::memory_order_relaxed);
+        out.dedupHits = values[STAT_DEDUP_HITS].load(boost::memory_order_relaxed);
+        out.exportAllocations = values[STAT_EXPORT_ALLOCATIONS].load(boost::memory_order_relaxed);
+
+        const double rate = epoch.NanosecondsPerTick();
+        out.readNanoseconds = uint64_t(values[STAT_READ_TIME].load(boost::memory_order_relaxed) * rate);
+        out.parseNanoseconds = uint64_t(values[STAT_PARSE_TIME].load(boost::memory_order_relaxed) * rate);
+        out.validateNanoseconds = uint64_t(values[STAT_VALIDATE_TIME].load(boost::memory_order_relaxed) * rate);
+        out.transcodeNanoseconds = uint64_t(values[STAT_TRANSCODE_TIME].load(boost::memory_order_relaxed) * rate);
+        out.dedupNanoseconds = uint64_t(values[STAT_DEDUP_TIME].load(boost::memory_order_relaxed) * rate);
+        out.writeNanoseconds = uint64_t(values[STAT_WRITE_TIME].load(boost::memory_order_relaxed) * rate);
+    }
+
+    bool decode_stats::Validate(const char * str, const size_t length) {
+        decoded++;
+        if (decoded % sampleInterval != 0)
+            return IsValidUTF8(str, length);
+
+        const uint64_t start = Ticks();
+        const bool valid = IsValidUTF8(str, length);
+        validateTicks += (Ticks() - start) * sampleInterval;
+        return valid;
+    }
+
+    void decode_stats::AddTo(stats& target) const {
+        target.Add(STAT_STRINGS_DECODED, decoded);
+        target.Add(STAT_STRINGS_TRANSCODED, transcoded);
+        target.Add(STAT_VALIDATE_TIME, validateTicks);
+        target.Add(STAT_TRANSCODE_TIME, transcodeTicks);
+    }
+#endif
+
+    /* Constructed when the library is loaded, as function-local statics
+       aren't constructed thread-safely by all the supported compilers. */
+    static stats global;
+
+    stats& GlobalStats() {
+        return global;
+    }
+}
@@ -0,0 +1,135 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_STATS_H__
+#define __LIBSTRINGS_STATS_H__
+
+#include "libstrings.h"
+#include "simd.h"
+#include <stdint.h>
+#include <cstring>
+
+#ifndef LIBSTRINGS_NO_STATS
+#   include <boost/atomic.hpp>
+#endif
+
+/* Counters and timings of the work the library does, kept per handle and
+   for the whole library. Timings are kept in ticks of the CPU's timestamp
+   counter where there is one, which is much cheaper to read than the system
+   clock, and converted to nanoseconds when read. Work done per string is
+   totalled locally and added once per call, so that the atomic adds aren't
+   made in tight loops. Defining LIBSTRINGS_NO_STATS compiles it all out. */
+namespace libstrings {
+    enum stat_id {
+        STAT_BYTES_READ,
+        STAT_BYTES_WRITTEN,
+        STAT_STRINGS_DECODED,
+        STAT_STRINGS_TRANSCODED,
+        STAT_DEDUP_HITS,
+        STAT_EXPORT_ALLOCATIONS,
+
+        //Timings, in ticks.
+        STAT_READ_TIME,
+        STAT_PARSE_TIME,
+        STAT_VALIDATE_TIME,
+        STAT_TRANSCODE_TIME,
+        STAT_DEDUP_TIME,
+        STAT_WRITE_TIME,
+
+        STAT_COUNT
+    };
+
+#ifdef LIBSTRINGS_NO_STATS
+    inline uint64_t Ticks() { return 0; }
+
+    class stats {
+    public:
+        explicit stats(stats * parent = NULL) {}
+
+        void Add(const stat_id id, const uint64_t value) {}
+        void Get(st_stats& out) const { memset(&out, 0, sizeof(out)); }
+    };
+#else
+    uint64_t Ticks();
+
+    class stats {
+    public:
+        explicit stats(stats * parent = NULL);  //Everything added is also added to parent.
+
+        void Add(const stat_id id, const uint64_t value);
+        void Get(st_stats& out) const;
+    private:
+        boost::atomic<uint64_t> values[STAT_COUNT];
+        stats * parent;
+
+        //Not copyable.
+        stats(const stats&);
+        stats& operator = (const stats&);
+    };
+#endif
+
+    stats& GlobalStats();
+
+    /* What decoding strings took, totalled so that it's added to stats once.
+       Reading the time costs about as much as checking a short string, so
+       only one check in every sampleInterval is timed, and counted for all
+       of them. Transcoding is slow enough to time every time. */
+    class decode_stats {
+    public:
+#ifdef LIBSTRINGS_NO_STATS
+        void CountDecoded() {}
+        bool Validate(const char * str, const size_t length) { return IsValidUTF8(str, length); }
+        void AddValidateTicks(const uint64_t ticks) {}
+        void AddTranscodeTicks(const uint64_t ticks) {}
+        void AddTo(stats& target) const {}
+#else
+        decode_stats() : decoded(0), transcoded(0), validateTicks(0), transcodeTicks(0) {}
+
+        void CountDecoded() { decoded++; }
+        bool Validate(const char * str, const size_t length);  //Also counts the string as decoded.
+        void AddValidateTicks(const uint64_t ticks) { validateTicks += ticks; }
+        void AddTranscodeTicks(const uint64_t ticks) { transcoded++; transcodeTicks += ticks; }
+        void AddTo(stats& target) const;
+    private:
+        static const uint64_t sampleInterval = 32;
+
+        uint64_t decoded;
+        uint64_t transcoded;
+        uint64_t validateTicks;
+        uint64_t transcodeTicks;
+#endif
+    };
+
+    //Adds the ticks from its construction to its destruction to a timing.
+    class stat_timer {
+    public:
+        stat_timer(stats& target, const stat_id id) : target(target), id(id), start(Ticks()) {}
+        ~stat_timer() { target.Add(id, Ticks() - start); }
+    private:
+        stats& target;
+        const stat_id id;
+        const uint64_t start;
+    };
+}
+
+#endif
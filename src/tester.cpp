@@ -25,12 +25,831 @@
 #include "streams.h"
 
 #include <stdint.h>
+#include <cstdlib>
+#include <cstring>
 
 #include <boost/filesystem.hpp>
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
 
 using namespace std;
 
+namespace fs = boost::filesystem;
+
+//Gets a handle's strings by ID, or none if they can't be got.
+static map<uint32_t, string> GetStrings(st_strings_handle sh) {
+    map<uint32_t, string> strings;
+    st_string_data * dataArr;
+    size_t dataArrSize;
+    if (st_get_strings(sh, &dataArr, &dataArrSize) == LIBSTRINGS_OK) {
+        for (size_t i=0; i < dataArrSize; i++)
+            strings[dataArr[i].id] = dataArr[i].data;
+    }
+    return strings;
+}
+
+//Checks that the file at path holds the strings expected.
+static bool HasStrings(const fs::path& path, const char * encoding, const map<uint32_t, string>& expected) {
+    st_strings_handle sh;
+    if (st_open(&sh, path.string().c_str(), encoding) != LIBSTRINGS_OK)
+        return false;
+    const bool same = (GetStrings(sh) == expected);
+    st_close(sh);
+    return same;
+}
+
+static string ReadFile(const fs::path& path) {
+    libstrings::ifstream in(path, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+//Gets a path for a temporary file that doesn't exist yet.
+static fs::path TempPath(const string& extension) {
+    return fs::temp_directory_path() / fs::unique_path("libstrings-tester-%%%%%%%%" + extension);
+}
+
+//Copies the file at path to a temporary file for a test to change.
+static fs::path CopyToTemp(const char * path) {
+    const fs::path copy = TempPath(fs::path(path).extension().string());
+    fs::copy_file(path, copy);
+    return copy;
+}
+
+//Creates a handle for a new file holding the given strings.
+static unsigned int NewHandle(st_strings_handle& sh, const map<uint32_t, string>& strings) {
+    unsigned int ret = st_open(&sh, TempPath(".STRINGS").string().c_str(), "UTF-8");
+    if (ret != LIBSTRINGS_OK)
+        return ret;
+
+    for (map<uint32_t, string>::const_iterator it=strings.begin(), endIt=strings.end(); it != endIt && ret == LIBSTRINGS_OK; ++it)
+        ret = st_add_string(sh, it->first, it->second.c_str());
+    if (ret != LIBSTRINGS_OK)
+        st_close(sh);
+    return ret;
+}
+
+//Replaces the first string, removes the second and adds one, which keeps the number of strings the same.
+static bool EditStrings(st_strings_handle sh, const char * testMessage) {
+    const map<uint32_t, string> strings = GetStrings(sh);
+    if (strings.size() < 2)
+        return false;
+
+    map<uint32_t, string>::const_iterator it = strings.begin();
+    const uint32_t replaced = it->first;
+    const uint32_t removed = (++it)->first;
+    return st_replace_string(sh, replaced, testMessage) == LIBSTRINGS_OK
+        && st_remove_string(sh, removed) == LIBSTRINGS_OK
+        && st_add_string(sh, strings.rbegin()->first + 1, testMessage) == LIBSTRINGS_OK;
+}
+
+/* Opens a copy of the file at path in encoding with the given flags,
+   edits its strings and saves them back to it in saveEncoding with
+   LIBSTRINGS_SAVE_INCREMENTAL, after touching the copy if changeFile is
+   true. A full save of the same strings is compared with the copy to tell
+   whether the save was done incrementally, then the copy and handle are
+   checked to hold the edited strings. */
+static void TestIncrementalSave(libstrings::ofstream& out, const char * path, const unsigned int flags, const string& newString, const bool changeFile, const char * encoding, const char * saveEncoding, const bool expectIncremental) {
+    try {
+        const fs::path copy = CopyToTemp(path);
+        const fs::path fullPath = copy.parent_path() / ("full-" + copy.filename().string());
+        st_strings_handle sh;
+
+        unsigned int ret = st_open_ex(&sh, copy.string().c_str(), encoding, flags);
+        if (ret != LIBSTRINGS_OK)
+            out << '\t' << "st_open_ex(...) failed! Return code: " << ret << endl;
+        else {
+            if (!EditStrings(sh, newString.c_str()))
+                out << '\t' << "Could not edit the strings." << endl;
+            else {
+                const map<uint32_t, string> expected = GetStrings(sh);
+                if (changeFile)
+                    fs::last_write_time(copy, fs::last_write_time(copy) - 10);
+
+                ret = st_save_ex(sh, copy.string().c_str(), saveEncoding, LIBSTRINGS_SAVE_INCREMENTAL);
+                if (ret == LIBSTRINGS_OK)
+                    ret = st_save(sh, fullPath.string().c_str(), saveEncoding);
+
+                if (ret != LIBSTRINGS_OK)
+                    out << '\t' << "st_save_ex(...) failed! Return code: " << ret << endl;
+                else if ((ReadFile(copy) != ReadFile(fullPath)) != expectIncremental)
+                    out << '\t' << "st_save_ex(...) failed! The file was " << (expectIncremental ? "fully saved." : "saved incrementally.") << endl;
+                else if (!HasStrings(copy, saveEncoding, expected) || GetStrings(sh) != expected)
+                    out << '\t' << "st_save_ex(...) failed! The saved strings differ." << endl;
+                else
+                    out << '\t' << "st_save_ex(...) successful!" << endl;
+            }
+            st_close(sh);
+        }
+
+        fs::remove(copy);
+        fs::remove(fullPath);
+    } catch (fs::filesystem_error& e) {
+        out << '\t' << "Test failed! " << e.what() << endl;
+    }
+}
+
+/* Adds strings of many lengths to a copy of the file at path, made of
+   random characters from U+0080 to U+07FF, whose UTF-8 bytes are all 0x80
+   or above and so are mostly escaped when compressed. Odd lengths end
+   with an ASCII character. The copy is then opened with and without
+   LIBSTRINGS_OPEN_COMPRESSED, and every string compared. */
+static void TestCompressedOpen(libstrings::ofstream& out, const char * path, const unsigned int flags) {
+    try {
+        const fs::path copy = CopyToTemp(path);
+        st_strings_handle sh;
+        st_strings_handle compressed;
+        unsigned int ret = st_open(&sh, copy.string().c_str(), "UTF-8");
+        if (ret == LIBSTRINGS_OK) {
+            const map<uint32_t, string> strings = GetStrings(sh);
+            uint32_t id = strings.empty() ? 0 : strings.rbegin()->first + 1;
+            srand(1);
+            for (size_t length=1; length <= 300 && ret == LIBSTRINGS_OK; length++, id++) {
+                string str;
+                while (str.length() + 2 <= length) {
+                    const unsigned int c = 0x80 + rand() % 0x780;
+                    str += char(0xC0 | (c >> 6));
+                    str += char(0x80 | (c & 0x3F));
+                }
+                if (str.length() < length)
+                    str += 'a';
+                ret = st_add_string(sh, id, str.c_str());
+            }
+            if (ret == LIBSTRINGS_OK)
+                ret = st_save(sh, copy.string().c_str(), "UTF-8");
+            st_close(sh);
+        }
+
+        if (ret == LIBSTRINGS_OK)
+            ret = st_open(&sh, copy.string().c_str(), "UTF-8");
+        if (ret != LIBSTRINGS_OK)
+            out << '\t' << "Could not add strings to a copy of the file. Return code: " << ret << endl;
+        else {
+            ret = st_open_ex(&compressed, copy.string().c_str(), "UTF-8", flags);
+            if (ret != LIBSTRINGS_OK)
+                out << '\t' << "st_open_ex(...) failed! Return code: " << ret << endl;
+            else {
+                //Copied strings are decompressed into the copy, and fetched ones into the cache.
+                const map<uint32_t, string> expected = GetStrings(sh);
+                bool same = (GetStrings(compressed) == expected);
+                for (map<uint32_t, string>::const_iterator it=expected.begin(), endIt=expected.end(); it != endIt && same; ++it) {
+                    char * str;
+                    same = (st_get_string(compressed, it->first, &str) == LIBSTRINGS_OK && it->second == str);
+                }
+
+                if (same)
+                    out << '\t' << "st_open_ex(...) successful! Number of strings: " << expected.size() << endl;
+                else
+                    out << '\t' << "st_open_ex(...) failed! The strings differ from those read without compression." << endl;
+                st_close(compressed);
+            }
+            st_close(sh);
+        }
+
+        fs::remove(copy);
+    } catch (fs::filesystem_error& e) {
+        out << '\t' << "Test failed! " << e.what() << endl;
+    }
+}
+
+//Opens a directory with a strings extension, which must fail without throwing.
+static void TestOpenDirectory(libstrings::ofstream& out, const unsigned int flags) {
+    try {
+        const fs::path dir = TempPath(".STRINGS");
+        fs::create_directory(dir);
+
+        st_strings_handle sh;
+        const unsigned int ret = st_open_ex(&sh, dir.string().c_str(), "Windows-1252", flags);
+        if (ret == LIBSTRINGS_OK) {
+            out << '\t' << "st_open_ex(...) failed! A directory was opened." << endl;
+            st_close(sh);
+        } else if (ret != LIBSTRINGS_ERROR_FILE_READ_FAIL)
+            out << '\t' << "st_open_ex(...) failed! Return code: " << ret << endl;
+        else
+            out << '\t' << "st_open_ex(...) successful! The directory was not read." << endl;
+
+        fs::remove(dir);
+    } catch (fs::filesystem_error& e) {
+        out << '\t' << "Test failed! " << e.what() << endl;
+    }
+}
+
+/* Looks up IDs that exist, one that doesn't and a repeated one, and
+   checks the views and found bitmap, before and after the dense ID index
+   that lookups switch to is built. */
+static void TestGetStringsByIds(libstrings::ofstream& out) {
+    map<uint32_t, string> strings;
+    strings[1] = "one";
+    strings[2] = "two";
+    strings[5] = "five";
+
+    st_strings_handle sh;
+    unsigned int ret = NewHandle(sh, strings);
+    if (ret != LIBSTRINGS_OK) {
+        out << '\t' << "Could not create a handle. Return code: " << ret << endl;
+        return;
+    }
+
+    const uint32_t ids[] = {5, 3, 1, 5};
+    const size_t numIds = sizeof(ids) / sizeof(ids[0]);
+    for (size_t pass=0; pass < 2 && ret == LIBSTRINGS_OK; pass++) {
+        if (pass == 1)
+            ret = st_build_id_index(sh);
+
+        const st_string_view * views;
+        const uint8_t * found;
+        if (ret == LIBSTRINGS_OK)
+            ret = st_get_strings_by_ids(sh, ids, numIds, &views, &found);
+        if (ret != LIBSTRINGS_OK) {
+            out << '\t' << "st_get_strings_by_ids(...) failed! Return code: " << ret << endl;
+            break;
+        }
+
+        bool same = (found[0] == 0x0D);
+        for (size_t i=0; i < numIds && same; i++) {
+            if (strings.count(ids[i]) == 0)
+                same = (views[i].data == NULL);
+            else
+                same = (views[i].id == ids[i] && views[i].data != NULL && string(views[i].data, views[i].length) == strings[ids[i]]);
+        }
+
+        if (same)
+            out << '\t' << "st_get_strings_by_ids(...) successful!" << (pass == 1 ? " Using the ID index." : "") << endl;
+        else
+            out << '\t' << "st_get_strings_by_ids(...) failed! The strings or found bitmap are wrong." << endl;
+    }
+    st_close(sh);
+}
+
+/* Applies a batch with an invalid edit at the end, which must change
+   nothing, then a valid batch whose edits act on each other's IDs. */
+static void TestApplyEdits(libstrings::ofstream& out) {
+    map<uint32_t, string> strings;
+    strings[1] = "one";
+    strings[2] = "two";
+    strings[3] = "three";
+
+    st_strings_handle sh;
+    unsigned int ret = NewHandle(sh, strings);
+    if (ret != LIBSTRINGS_OK) {
+        out << '\t' << "Could not create a handle. Return code: " << ret << endl;
+        return;
+    }
+
+    const st_string_edit badEdits[] = {
+        {LIBSTRINGS_EDIT_REPLACE, 1, "uno"},
+        {LIBSTRINGS_EDIT_ADD, 4, "four"},
+        {LIBSTRINGS_EDIT_REMOVE, 9, NULL}
+    };
+    const uint8_t * statuses;
+    ret = st_apply_edits(sh, badEdits, 3, &statuses);
+    if (ret != LIBSTRINGS_ERROR_INVALID_ARGS)
+        out << '\t' << "st_apply_edits(...) failed! An invalid batch returned: " << ret << endl;
+    else if (statuses[0] != LIBSTRINGS_OK || statuses[1] != LIBSTRINGS_OK || statuses[2] != LIBSTRINGS_ERROR_INVALID_ARGS)
+        out << '\t' << "st_apply_edits(...) failed! The statuses of an invalid batch are wrong." << endl;
+    else if (GetStrings(sh) != strings)
+        out << '\t' << "st_apply_edits(...) failed! An invalid batch changed the strings." << endl;
+    else
+        out << '\t' << "st_apply_edits(...) successful! An invalid batch changed nothing." << endl;
+
+    const st_string_edit edits[] = {
+        {LIBSTRINGS_EDIT_ADD, 4, "four"},
+        {LIBSTRINGS_EDIT_REPLACE, 1, "uno"},
+        {LIBSTRINGS_EDIT_REMOVE, 2, NULL},
+        {LIBSTRINGS_EDIT_REPLACE, 4, "cuatro"}
+    };
+    ret = st_apply_edits(sh, edits, 4, &statuses);
+    if (ret != LIBSTRINGS_OK)
+        out << '\t' << "st_apply_edits(...) failed! Return code: " << ret << endl;
+    else {
+        char * str;
+        bool same = true;
+        for (size_t i=0; i < 4; i++)
+            same = same && (statuses[i] == LIBSTRINGS_OK);
+        same = same && st_get_string(sh, 1, &str) == LIBSTRINGS_OK && string(str) == "uno";
+        same = same && st_get_string(sh, 2, &str) == LIBSTRINGS_ERROR_INVALID_ARGS;
+        same = same && st_get_string(sh, 3, &str) == LIBSTRINGS_OK && string(str) == "three";
+        same = same && st_get_string(sh, 4, &str) == LIBSTRINGS_OK && string(str) == "cuatro";
+
+        if (same)
+            out << '\t' << "st_apply_edits(...) successful!" << endl;
+        else
+            out << '\t' << "st_apply_edits(...) failed! The edited strings are wrong." << endl;
+    }
+    st_close(sh);
+}
+
+/* Writes the given strings to a file at path using a writer, repeating
+   the first ID partway through, which must be rejected without affecting
+   the rest. */
+static unsigned int WriteStrings(libstrings::ofstream& out, const fs::path& path, const char * encoding, const map<uint32_t, string>& strings) {
+    st_writer_handle wh;
+    unsigned int ret = st_writer_open(&wh, path.string().c_str(), encoding);
+    if (ret != LIBSTRINGS_OK)
+        return ret;
+
+    size_t added = 0;
+    for (map<uint32_t, string>::const_iterator it=strings.begin(), endIt=strings.end(); it != endIt && ret == LIBSTRINGS_OK; ++it, added++) {
+        ret = st_writer_add(wh, it->first, it->second.c_str());
+        if (ret == LIBSTRINGS_OK && added == strings.size() / 2 && st_writer_add(wh, strings.begin()->first, "duplicate") == LIBSTRINGS_OK) {
+            out << '\t' << "st_writer_add(...) failed! A duplicate ID was added." << endl;
+            ret = LIBSTRINGS_ERROR_INVALID_ARGS;
+        }
+    }
+    if (ret == LIBSTRINGS_OK)
+        ret = st_writer_finish(wh);
+    st_writer_close(wh);
+    return ret;
+}
+
+//Gets strings for a writer to write, including repeated and non-ASCII ones.
+static map<uint32_t, string> WriterStrings() {
+    map<uint32_t, string> strings;
+    strings[7] = "Iron Sword";
+    strings[3] = "Steel Sword";
+    strings[12] = "Iron Sword";
+    strings[100] = "\xC3\x84rger im Dorf";
+    strings[4000000000u] = "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82";
+    strings[9] = "";
+    return strings;
+}
+
+//Writes a file with a writer and reads it back in the given encoding.
+static void TestWriter(libstrings::ofstream& out, const char * extension, const char * encoding) {
+    try {
+        const fs::path path = TempPath(extension);
+        map<uint32_t, string> strings = WriterStrings();
+        if (string(encoding) != "UTF-8")
+            strings.erase(4000000000u);  //Cyrillic can't be written in Windows-1252.
+
+        const unsigned int ret = WriteStrings(out, path, encoding, strings);
+        if (ret != LIBSTRINGS_OK)
+            out << '\t' << "st_writer_finish(...) failed! Return code: " << ret << endl;
+        else if (!HasStrings(path, encoding, strings))
+            out << '\t' << "st_writer_finish(...) failed! The file holds different strings." << endl;
+        else
+            out << '\t' << "st_writer_finish(...) successful! Number of strings: " << strings.size() << endl;
+
+        fs::remove(path);
+    } catch (fs::filesystem_error& e) {
+        out << '\t' << "Test failed! " << e.what() << endl;
+    }
+}
+
+//Collects the strings visited by st_iterate(), stopping after limit of them if it isn't 0.
+struct iterate_results {
+    iterate_results(const size_t limit) : limit(limit), visited(0) {}
+
+    const size_t limit;
+    size_t visited;
+    map<uint32_t, string> strings;
+};
+
+static int CollectString(void * userdata, uint32_t id, const char * data, size_t length) {
+    iterate_results * results = static_cast<iterate_results*>(userdata);
+    results->strings[id] = string(data, length);
+    results->visited++;
+    return results->visited == results->limit ? 1 : 0;
+}
+
+/* Writes a file with a writer, then walks it with st_iterate(), stopping
+   partway through and not, and with a cursor, comparing what each visits
+   with what was written. */
+static void TestStreamingRead(libstrings::ofstream& out, const char * extension, const char * encoding) {
+    try {
+        const fs::path path = TempPath(extension);
+        map<uint32_t, string> strings = WriterStrings();
+        if (string(encoding) != "UTF-8")
+            strings.erase(4000000000u);
+
+        unsigned int ret = WriteStrings(out, path, encoding, strings);
+        if (ret != LIBSTRINGS_OK) {
+            out << '\t' << "Could not write a file. Return code: " << ret << endl;
+            fs::remove(path);
+            return;
+        }
+
+        iterate_results all(0);
+        ret = st_iterate(path.string().c_str(), encoding, CollectString, &all);
+        if (ret != LIBSTRINGS_OK)
+            out << '\t' << "st_iterate(...) failed! Return code: " << ret << endl;
+        else if (all.visited != strings.size() || all.strings != strings)
+            out << '\t' << "st_iterate(...) failed! The strings visited differ from those written." << endl;
+        else
+            out << '\t' << "st_iterate(...) successful! Number of strings: " << all.visited << endl;
+
+        iterate_results some(2);
+        ret = st_iterate(path.string().c_str(), encoding, CollectString, &some);
+        if (ret != LIBSTRINGS_OK)
+            out << '\t' << "st_iterate(...) failed! Return code: " << ret << endl;
+        else if (some.visited != 2)
+            out << '\t' << "st_iterate(...) failed! Stopping visited " << some.visited << " strings." << endl;
+        else
+            out << '\t' << "st_iterate(...) successful! Stopped after 2 strings." << endl;
+
+        st_cursor_handle ch;
+        ret = st_cursor_open(&ch, path.string().c_str(), encoding);
+        if (ret != LIBSTRINGS_OK)
+            out << '\t' << "st_cursor_open(...) failed! Return code: " << ret << endl;
+        else {
+            map<uint32_t, string> visited;
+            size_t numVisited = 0;
+            const st_string_view * view;
+            while ((ret = st_cursor_next(ch, &view)) == LIBSTRINGS_OK && view != NULL) {
+                visited[view->id] = string(view->data, view->length);
+                numVisited++;
+            }
+
+            if (ret != LIBSTRINGS_OK)
+                out << '\t' << "st_cursor_next(...) failed! Return code: " << ret << endl;
+            else if (numVisited != strings.size() || visited != strings)
+                out << '\t' << "st_cursor_next(...) failed! The strings visited differ from those written." << endl;
+            else
+                out << '\t' << "st_cursor_next(...) successful! Number of strings: " << numVisited << endl;
+            st_cursor_close(ch);
+        }
+
+        fs::remove(path);
+    } catch (fs::filesystem_error& e) {
+        out << '\t' << "Test failed! " << e.what() << endl;
+    }
+}
+
+/* Overlays every string of one handle onto another, with and without
+   LIBSTRINGS_OVERLAY_ADD_MISSING, then only the selected IDs. */
+static void TestOverlay(libstrings::ofstream& out) {
+    map<uint32_t, string> dstStrings;
+    dstStrings[1] = "one";
+    dstStrings[2] = "two";
+    dstStrings[3] = "three";
+    map<uint32_t, string> srcStrings;
+    srcStrings[2] = "dos";
+    srcStrings[3] = "tres";
+    srcStrings[4] = "cuatro";
+
+    st_strings_handle dst, src;
+    unsigned int ret = NewHandle(src, srcStrings);
+    if (ret != LIBSTRINGS_OK) {
+        out << '\t' << "Could not create a handle. Return code: " << ret << endl;
+        return;
+    }
+
+    st_overlay_selector selector;
+    memset(&selector, 0, sizeof(selector));
+    selector.type = LIBSTRINGS_SELECT_ALL;
+
+    const uint32_t ids[] = {3, 4};
+    for (size_t pass=0; pass < 3; pass++) {
+        const unsigned int flags = (pass == 0 ? 0 : LIBSTRINGS_OVERLAY_ADD_MISSING);
+        map<uint32_t, string> expected = dstStrings;
+        if (pass == 2) {
+            selector.type = LIBSTRINGS_SELECT_IDS;
+            selector.ids = ids;
+            selector.numIds = 2;
+        } else
+            expected[2] = srcStrings[2];
+        expected[3] = srcStrings[3];
+        if (flags & LIBSTRINGS_OVERLAY_ADD_MISSING)
+            expected[4] = srcStrings[4];
+
+        ret = NewHandle(dst, dstStrings);
+        if (ret != LIBSTRINGS_OK) {
+            out << '\t' << "Could not create a handle. Return code: " << ret << endl;
+            break;
+        }
+
+        const char * description = (pass == 0 ? "every string" : pass == 1 ? "every string, adding missing IDs" : "selected IDs, adding missing IDs");
+        ret = st_overlay(dst, src, &selector, flags);
+        if (ret != LIBSTRINGS_OK)
+            out << '\t' << "st_overlay(...) failed for " << description << "! Return code: " << ret << endl;
+        else if (GetStrings(dst) != expected || GetStrings(src) != srcStrings)
+            out << '\t' << "st_overlay(...) failed for " << description << "! The strings are wrong." << endl;
+        else
+            out << '\t' << "st_overlay(...) successful for " << description << "!" << endl;
+        st_close(dst);
+    }
+    st_close(src);
+}
+
+//Gets the IDs of a handle's strings that match the patterns, sorted.
+static unsigned int FilterIds(st_strings_handle sh, const st_pattern * patterns, const size_t numPatterns, vector<uint32_t>& ids) {
+    const uint32_t * idArr;
+    size_t idArrSize;
+    const unsigned int ret = st_filter_ids(sh, patterns, numPatterns, &idArr, &idArrSize);
+    if (ret == LIBSTRINGS_OK) {
+        ids.assign(idArr, idArr + idArrSize);
+        sort(ids.begin(), ids.end());
+    }
+    return ret;
+}
+
+/* Filters strings by prefix and by substring, including a substring far
+   enough into a long string to be found by the vectorised scan, and a
+   repeated byte pattern that the scan must not stop at early. */
+static void TestFilterIds(libstrings::ofstream& out) {
+    map<uint32_t, string> strings;
+    strings[1] = "Iron Sword";
+    strings[2] = "Steel Sword";
+    strings[3] = "Iron Dagger";
+    strings[4] = "Bow";
+    strings[5] = string(100, 'x') + "Dagger" + string(100, 'x');
+    strings[6] = string(100, 'D') + "agge";
+
+    st_strings_handle sh;
+    unsigned int ret = NewHandle(sh, strings);
+    if (ret != LIBSTRINGS_OK) {
+        out << '\t' << "Could not create a handle. Return code: " << ret << endl;
+        return;
+    }
+
+    const st_pattern patterns[] = {
+        {"Iron", LIBSTRINGS_PATTERN_PREFIX},
+        {"Dagger", LIBSTRINGS_PATTERN_CONTAINS},
+        {"Sword", LIBSTRINGS_PATTERN_PREFIX}
+    };
+    vector<uint32_t> ids;
+    ret = FilterIds(sh, patterns, 3, ids);
+    if (ret != LIBSTRINGS_OK)
+        out << '\t' << "st_filter_ids(...) failed! Return code: " << ret << endl;
+    else if (ids.size() != 3 || ids[0] != 1 || ids[1] != 3 || ids[2] != 5)
+        out << '\t' << "st_filter_ids(...) failed! Wrong IDs matched: " << ids.size() << endl;
+    else
+        out << '\t' << "st_filter_ids(...) successful! Number of IDs: " << ids.size() << endl;
+
+    const st_pattern everything[] = {
+        {"", LIBSTRINGS_PATTERN_CONTAINS}
+    };
+    ret = FilterIds(sh, everything, 1, ids);
+    if (ret != LIBSTRINGS_OK)
+        out << '\t' << "st_filter_ids(...) failed! Return code: " << ret << endl;
+    else if (ids.size() != strings.size())
+        out << '\t' << "st_filter_ids(...) failed! An empty pattern matched " << ids.size() << " strings." << endl;
+    else if (FilterIds(sh, patterns, 0, ids) != LIBSTRINGS_OK || !ids.empty())
+        out << '\t' << "st_filter_ids(...) failed! No patterns matched strings." << endl;
+    else
+        out << '\t' << "st_filter_ids(...) successful! An empty pattern matched every string, and no patterns none." << endl;
+    st_close(sh);
+}
+
+//Checks that searching a handle finds exactly the expected IDs, which are in ascending order.
+static bool SearchFinds(st_strings_handle sh, const char * query, const unsigned int flags, const vector<uint32_t>& expected) {
+    const uint32_t * ids;
+    size_t numIds;
+    if (st_search(sh, query, flags, &ids, &numIds) != LIBSTRINGS_OK)
+        return false;
+    return vector<uint32_t>(ids, ids + numIds) == expected;
+}
+
+/* Searches German and Russian strings with and without
+   LIBSTRINGS_SEARCH_IGNORE_CASE, for words whose letters that differ in
+   case include non-ASCII ones (A with an umlaut, and the Cyrillic for
+   "privet"), then searches again after a change. */
+static void TestSearch(libstrings::ofstream& out) {
+    map<uint32_t, string> strings;
+    strings[1] = "\xC3\x84rger im Dorf";
+    strings[2] = "GRO\xC3\x9F" "ER \xC3\x84RGER";
+    strings[3] = "kein Treffer";
+    strings[4] = "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82 \xD0\xBC\xD0\xB8\xD1\x80";
+    strings[5] = "\xD0\x9F\xD0\xA0\xD0\x98\xD0\x92\xD0\x95\xD0\xA2";
+
+    st_strings_handle sh;
+    unsigned int ret = NewHandle(sh, strings);
+    if (ret != LIBSTRINGS_OK) {
+        out << '\t' << "Could not create a handle. Return code: " << ret << endl;
+        return;
+    }
+
+    vector<uint32_t> latin, cyrillic, exact, none, all;
+    latin.push_back(1);
+    latin.push_back(2);
+    cyrillic.push_back(4);
+    cyrillic.push_back(5);
+    exact.push_back(1);
+    for (uint32_t id=1; id <= 5; id++)
+        all.push_back(id);
+
+    if (!SearchFinds(sh, "\xC3\xA4rger", LIBSTRINGS_SEARCH_IGNORE_CASE, latin)
+        || !SearchFinds(sh, "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82", LIBSTRINGS_SEARCH_IGNORE_CASE, cyrillic))
+        out << '\t' << "st_search(...) failed! Ignoring case found the wrong strings." << endl;
+    else if (!SearchFinds(sh, "\xC3\x84rger", 0, exact) || !SearchFinds(sh, "\xC3\xA4rger", 0, none))
+        out << '\t' << "st_search(...) failed! Matching case found the wrong strings." << endl;
+    else if (!SearchFinds(sh, "", 0, all))
+        out << '\t' << "st_search(...) failed! An empty query didn't find every string." << endl;
+    else
+        out << '\t' << "st_search(...) successful!" << endl;
+
+    const uint32_t * ids;
+    size_t numIds;
+    ret = st_search(sh, "\xFF", 0, &ids, &numIds);
+    if (ret != LIBSTRINGS_ERROR_BAD_STRING)
+        out << '\t' << "st_search(...) failed! An invalid query returned: " << ret << endl;
+    else
+        out << '\t' << "st_search(...) successful! An invalid query was rejected." << endl;
+
+    //The index must be rebuilt for the changed strings.
+    latin.erase(latin.begin());
+    if (st_replace_string(sh, 1, "Frieden im Dorf") != LIBSTRINGS_OK || !SearchFinds(sh, "\xC3\xA4rger", LIBSTRINGS_SEARCH_IGNORE_CASE, latin))
+        out << '\t' << "st_search(...) failed! A replaced string was still found." << endl;
+    else
+        out << '\t' << "st_search(...) successful! A replaced string was not found." << endl;
+    st_close(sh);
+}
+
+/* Saves a snapshot of a copy of the file at path and opens it, comparing
+   its strings with the copy's, before and after changing one. Then the
+   copy is saved with a changed string, after which the snapshot must be
+   rejected. */
+static void TestSnapshot(libstrings::ofstream& out, const char * path, const char * encoding) {
+    try {
+        const fs::path copy = CopyToTemp(path);
+        const fs::path snapshotPath = TempPath(".snapshot");
+        st_strings_handle sh, snapshot;
+
+        unsigned int ret = st_open(&sh, copy.string().c_str(), encoding);
+        if (ret == LIBSTRINGS_OK) {
+            ret = st_save_snapshot(sh, snapshotPath.string().c_str());
+            if (ret != LIBSTRINGS_OK)
+                out << '\t' << "st_save_snapshot(...) failed! Return code: " << ret << endl;
+            else {
+                ret = st_open_snapshot(&snapshot, snapshotPath.string().c_str(), copy.string().c_str());
+                if (ret != LIBSTRINGS_OK)
+                    out << '\t' << "st_open_snapshot(...) failed! Return code: " << ret << endl;
+                else {
+                    map<uint32_t, string> expected = GetStrings(sh);
+                    bool same = !expected.empty() && GetStrings(snapshot) == expected;
+                    for (map<uint32_t, string>::const_iterator it=expected.begin(), endIt=expected.end(); it != endIt && same; ++it) {
+                        st_string_view view;
+                        same = (st_get_string_view(snapshot, it->first, &view) == LIBSTRINGS_OK && string(view.data, view.length) == it->second);
+                    }
+
+                    //Changing a snapshot's strings moves them out of the mapped snapshot.
+                    const uint32_t id = expected.begin()->first;
+                    expected[id] = "This is a changed string.";
+                    same = same && st_replace_string(snapshot, id, expected[id].c_str()) == LIBSTRINGS_OK && GetStrings(snapshot) == expected;
+
+                    if (same)
+                        out << '\t' << "st_open_snapshot(...) successful! Number of strings: " << expected.size() << endl;
+                    else
+                        out << '\t' << "st_open_snapshot(...) failed! The strings differ from the file's." << endl;
+                    st_close(snapshot);
+
+                    ret = st_replace_string(sh, id, expected[id].c_str());
+                    if (ret == LIBSTRINGS_OK)
+                        ret = st_save(sh, copy.string().c_str(), "UTF-8");
+                    if (ret != LIBSTRINGS_OK)
+                        out << '\t' << "Could not change the file. Return code: " << ret << endl;
+                    else {
+                        ret = st_open_snapshot(&snapshot, snapshotPath.string().c_str(), copy.string().c_str());
+                        if (ret == LIBSTRINGS_OK) {
+                            out << '\t' << "st_open_snapshot(...) failed! The snapshot of a changed file was opened." << endl;
+                            st_close(snapshot);
+                        } else if (ret != LIBSTRINGS_ERROR_FILE_READ_FAIL)
+                            out << '\t' << "st_open_snapshot(...) failed! Return code: " << ret << endl;
+                        else
+                            out << '\t' << "st_open_snapshot(...) successful! The snapshot of a changed file was rejected." << endl;
+                    }
+                }
+            }
+            st_close(sh);
+        } else
+            out << '\t' << "st_open(...) failed! Return code: " << ret << endl;
+
+        fs::remove(copy);
+        fs::remove(snapshotPath);
+    } catch (fs::filesystem_error& e) {
+        out << '\t' << "Test failed! " << e.what() << endl;
+    }
+}
+
+//Checks that a range query gets the expected strings, in order.
+static bool RangeGets(st_strings_handle sh, const uint32_t lo, const uint32_t hi, const map<uint32_t, string>& strings) {
+    const st_string_view * views;
+    size_t numViews;
+    if (st_get_string_range(sh, lo, hi, &views, &numViews) != LIBSTRINGS_OK)
+        return false;
+
+    map<uint32_t, string>::const_iterator it = strings.lower_bound(lo);
+    for (size_t i=0; i < numViews; i++, ++it) {
+        if (it == strings.end() || it->first > hi || views[i].id != it->first || string(views[i].data, views[i].length) != it->second)
+            return false;
+    }
+    return it == strings.end() || it->first > hi;
+}
+
+/* Gets ranges of sparse IDs, which are looked up through the sorted
+   index, and then of dense IDs, which also get a table of every ID, and
+   then again after a string is replaced. */
+static void TestGetStringRange(libstrings::ofstream& out) {
+    for (size_t pass=0; pass < 2; pass++) {
+        map<uint32_t, string> strings;
+        for (uint32_t i=1; i <= 100; i++)
+            strings[pass == 0 ? i * 1000 : i] = string(i % 10 + 1, char('a' + i % 26));
+        if (pass == 0)
+            strings[0xFFFFFFFF] = "last";
+
+        st_strings_handle sh;
+        unsigned int ret = NewHandle(sh, strings);
+        if (ret != LIBSTRINGS_OK) {
+            out << '\t' << "Could not create a handle. Return code: " << ret << endl;
+            return;
+        }
+
+        const char * description = (pass == 0 ? "sparse IDs" : "dense IDs");
+        const uint32_t lo = (pass == 0 ? 15500 : 15);
+        const uint32_t hi = (pass == 0 ? 35000 : 35);
+        if (!RangeGets(sh, 0, 0xFFFFFFFF, strings) || !RangeGets(sh, lo, hi, strings) || !RangeGets(sh, hi, hi, strings))
+            out << '\t' << "st_get_string_range(...) failed for " << description << "! The strings got are wrong." << endl;
+        else if (!RangeGets(sh, 200000, 300000, strings) || !RangeGets(sh, 0xFFFFFFFF, 0xFFFFFFFF, strings))
+            out << '\t' << "st_get_string_range(...) failed for " << description << "! The strings got past the highest ID are wrong." << endl;
+        else {
+            strings[hi] = "This is a changed string.";
+            if (st_replace_string(sh, hi, strings[hi].c_str()) != LIBSTRINGS_OK || !RangeGets(sh, lo, hi, strings))
+                out << '\t' << "st_get_string_range(...) failed for " << description << "! A replaced string wasn't got." << endl;
+            else
+                out << '\t' << "st_get_string_range(...) successful for " << description << "!" << endl;
+        }
+        st_close(sh);
+    }
+}
+
+//Checks that a diff holds exactly one added, one removed and one changed ID.
+static bool DiffIs(const st_diff_result& result, const uint32_t added, const uint32_t removed, const uint32_t changed) {
+    return result.numAdded == 1 && result.added[0] == added
+        && result.numRemoved == 1 && result.removed[0] == removed
+        && result.numChanged == 1 && result.changed[0] == changed;
+}
+
+/* Diffs two handles with one ID added, one removed and one changed, then
+   the same handle with itself, then the old handle with a snapshot of the
+   new one saved to a file, whose saved hashes are used. */
+static void TestDiff(libstrings::ofstream& out) {
+    map<uint32_t, string> oldStrings;
+    oldStrings[1] = "one";
+    oldStrings[2] = "two";
+    oldStrings[3] = "three";
+    map<uint32_t, string> newStrings = oldStrings;
+    newStrings.erase(1);
+    newStrings[3] = "tres";
+    newStrings[4] = "four";
+
+    st_strings_handle a, b;
+    unsigned int ret = NewHandle(a, oldStrings);
+    if (ret == LIBSTRINGS_OK) {
+        ret = NewHandle(b, newStrings);
+        if (ret != LIBSTRINGS_OK)
+            st_close(a);
+    }
+    if (ret != LIBSTRINGS_OK) {
+        out << '\t' << "Could not create a handle. Return code: " << ret << endl;
+        return;
+    }
+
+    st_diff_result result;
+    ret = st_diff(a, b, &result);
+    if (ret != LIBSTRINGS_OK)
+        out << '\t' << "st_diff(...) failed! Return code: " << ret << endl;
+    else if (!DiffIs(result, 4, 1, 3))
+        out << '\t' << "st_diff(...) failed! The IDs that differ are wrong." << endl;
+    else if (st_diff(a, a, &result) != LIBSTRINGS_OK || result.numAdded != 0 || result.numRemoved != 0 || result.numChanged != 0)
+        out << '\t' << "st_diff(...) failed! A handle differs from itself." << endl;
+    else
+        out << '\t' << "st_diff(...) successful!" << endl;
+
+    try {
+        const fs::path path = TempPath(".STRINGS");
+        const fs::path snapshotPath = TempPath(".snapshot");
+        st_strings_handle snapshot;
+
+        ret = st_save(b, path.string().c_str(), "UTF-8");
+        if (ret == LIBSTRINGS_OK)
+            ret = st_save_snapshot(b, snapshotPath.string().c_str());
+        if (ret == LIBSTRINGS_OK)
+            ret = st_open_snapshot(&snapshot, snapshotPath.string().c_str(), path.string().c_str());
+        if (ret != LIBSTRINGS_OK)
+            out << '\t' << "Could not open a snapshot. Return code: " << ret << endl;
+        else {
+            ret = st_diff(a, snapshot, &result);
+            if (ret != LIBSTRINGS_OK)
+                out << '\t' << "st_diff(...) failed! Return code: " << ret << endl;
+            else if (!DiffIs(result, 4, 1, 3))
+                out << '\t' << "st_diff(...) failed! The IDs that differ from a snapshot are wrong." << endl;
+            else
+                out << '\t' << "st_diff(...) successful! Using a snapshot's hashes." << endl;
+            st_close(snapshot);
+        }
+
+        fs::remove(path);
+        fs::remove(snapshotPath);
+    } catch (fs::filesystem_error& e) {
+        out << '\t' << "Test failed! " << e.what() << endl;
+    }
+    st_close(a);
+    st_close(b);
+}
+
 int main() {
     st_strings_handle sh;
     const char * path = "/home/hvt/Code/skyrim/data/SkyrimSE_Strings_English/Strings/Hearthfires_English.DLSTRINGS";
@@ -172,6 +991,70 @@ int main() {
     out << "TESTING st_close(...)" << endl;
     st_close(sh);
 
+    out << "TESTING st_save_ex(...) incrementally after replacing, adding and removing strings" << endl;
+    TestIncrementalSave(out, path, 0, testMessage, false, "UTF-8", "UTF-8", true);
+
+    out << "TESTING st_save_ex(...) incrementally to a file that has changed since it was opened" << endl;
+    TestIncrementalSave(out, path, 0, testMessage, true, "UTF-8", "UTF-8", false);
+
+    out << "TESTING st_save_ex(...) incrementally once the data block would grow too much" << endl;
+    TestIncrementalSave(out, path, 0, string(2 * boost::filesystem::file_size(path), 'x'), false, "UTF-8", "UTF-8", false);
+
+    out << "TESTING st_save_ex(...) incrementally in a different encoding" << endl;
+    TestIncrementalSave(out, path, 0, testMessage, false, "Windows-1252", "UTF-8", false);
+
+    //The unchanged strings are views into the mapped file, so must be copied out before it is written to.
+    out << "TESTING st_save_ex(...) incrementally to a memory-mapped file" << endl;
+    TestIncrementalSave(out, path, LIBSTRINGS_OPEN_MAPPED, testMessage, false, "UTF-8", "UTF-8", true);
+
+    out << "TESTING st_open_ex(...) with LIBSTRINGS_OPEN_COMPRESSED" << endl;
+    TestCompressedOpen(out, path, LIBSTRINGS_OPEN_COMPRESSED);
+
+    out << "TESTING st_open_ex(...) with LIBSTRINGS_OPEN_COMPRESSED and LIBSTRINGS_OPEN_MAPPED" << endl;
+    TestCompressedOpen(out, path, LIBSTRINGS_OPEN_COMPRESSED | LIBSTRINGS_OPEN_MAPPED);
+
+    out << "TESTING st_open_ex(...) on a directory" << endl;
+    TestOpenDirectory(out, 0);
+
+    out << "TESTING st_open_ex(...) on a directory with LIBSTRINGS_OPEN_MAPPED" << endl;
+    TestOpenDirectory(out, LIBSTRINGS_OPEN_MAPPED);
+
+    out << "TESTING st_get_strings_by_ids(...)" << endl;
+    TestGetStringsByIds(out);
+
+    out << "TESTING st_apply_edits(...)" << endl;
+    TestApplyEdits(out);
+
+    out << "TESTING st_writer_add(...) and st_writer_finish(...) with a STRINGS file" << endl;
+    TestWriter(out, ".STRINGS", "UTF-8");
+
+    out << "TESTING st_writer_add(...) and st_writer_finish(...) with a DLSTRINGS file in Windows-1252" << endl;
+    TestWriter(out, ".DLSTRINGS", "Windows-1252");
+
+    out << "TESTING st_iterate(...) and st_cursor_next(...) with a STRINGS file" << endl;
+    TestStreamingRead(out, ".STRINGS", "UTF-8");
+
+    out << "TESTING st_iterate(...) and st_cursor_next(...) with a DLSTRINGS file in Windows-1252" << endl;
+    TestStreamingRead(out, ".DLSTRINGS", "Windows-1252");
+
+    out << "TESTING st_overlay(...)" << endl;
+    TestOverlay(out);
+
+    out << "TESTING st_filter_ids(...)" << endl;
+    TestFilterIds(out);
+
+    out << "TESTING st_search(...)" << endl;
+    TestSearch(out);
+
+    out << "TESTING st_save_snapshot(...) and st_open_snapshot(...)" << endl;
+    TestSnapshot(out, path, "Windows-1252");
+
+    out << "TESTING st_get_string_range(...)" << endl;
+    TestGetStringRange(out);
+
+    out << "TESTING st_diff(...)" << endl;
+    TestDiff(out);
+
     out.close();
     return 0;
 }
@@ -0,0 +1,242 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "writer.h"
+#include "error.h"
+#include "helpers.h"
+#include "stats.h"
+#include <cstring>
+#include <limits>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
+
+using namespace std;
+using namespace libstrings;
+
+namespace fs = boost::filesystem;
+
+namespace {
+    //String data is written to the temporary file in blocks of this size.
+    const size_t bufferSize = 256 * 1024;
+}
+
+_strings_writer_int::_strings_writer_int(const string& path, const string& encoding) : path(path), encoding(encoding), isUTF8(boost::iequals("UTF-8", encoding)), finished(false), failed(false), dataSize(0), flushedSize(0) {
+    //Check extension.
+    const string ext = fs::path(path).extension().string();
+    if (boost::iequals(ext, ".strings"))
+        isDotStrings = true;
+    else if (boost::iequals(ext, ".ilstrings") || boost::iequals(ext, ".dlstrings"))
+        isDotStrings = false;
+    else
+        throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "File passed does not have a valid extension.");
+
+    //Put the temporary file next to the output, so that it's on the same drive.
+    try {
+        const fs::path outPath(path);
+        dataPath = (outPath.parent_path() / fs::unique_path(outPath.filename().string() + ".%%%%-%%%%-%%%%.tmp")).string();
+        dataFile.open(dataPath, ios::in | ios::out | ios::trunc | ios::binary);
+    } catch (exception& e) {
+        dataPath.clear();
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not create a temporary file for \"" + path + "\".");
+    }
+    if (!dataFile.is_open()) {
+        dataPath.clear();
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not create a temporary file for \"" + path + "\".");
+    }
+
+    buffer.reserve(bufferSize);
+}
+
+_strings_writer_int::~_strings_writer_int() {
+    try {
+        if (dataFile.is_open())
+            dataFile.close();
+    } catch (ios_base::failure&) {}
+
+    if (!dataPath.empty()) {
+        boost::system::error_code ec;
+        fs::remove(dataPath, ec);
+    }
+}
+
+/* Adds a UTF-8 string. Everything that can go wrong with the string itself is
+   checked before anything changes, so those errors leave the writer usable. */
+void _strings_writer_int::Add(const uint32_t id, const char * str, const size_t length) {
+    if (finished)
+        throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "The writer has already been finished.");
+    else if (failed)
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "An earlier write to \"" + dataPath + "\" failed.");
+    else if (ids.find(id) != ids.end())
+        throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID already exists.");
+    else if (ids.size() == numeric_limits<uint32_t>::max())
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Too many strings have been added to be written to \"" + path + "\".");
+
+    written_string out;
+    out.length = length;
+    string encoded;
+    if (!isUTF8) {
+        stat_timer timer(GlobalStats(), STAT_TRANSCODE_TIME);
+        encoded = FromUTF8(string(str, length), encoding);
+        str = encoded.data();
+        out.length = encoded.length();
+    }
+
+    //Look for an identical string that has been written already.
+    const size_t prefixSize = isDotStrings ? 0 : sizeof(uint32_t);
+    const size_t hash = boost::hash_range(str, str + out.length);
+    pair<boost::unordered_multimap<size_t, written_string>::iterator, boost::unordered_multimap<size_t, written_string>::iterator> range = hashes.equal_range(hash);
+    bool found = false;
+    try {
+        for (; range.first != range.second && !found; ++range.first) {
+            if (range.first->second.length == out.length && Matches(range.first->second, str)) {
+                out.offset = range.first->second.offset;
+                found = true;
+            }
+        }
+    } catch (...) {
+        failed = true;
+        throw;
+    }
+
+    if (!found && dataSize + prefixSize + out.length + 1 > numeric_limits<uint32_t>::max())
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "The strings are too large to be written to \"" + path + "\".");
+
+    try {
+        if (found)
+            GlobalStats().Add(STAT_DEDUP_HITS, 1);
+        else {
+            out.offset = dataSize;
+            if (!isDotStrings) {
+                //The length prefix includes the null terminator.
+                const uint32_t size = out.length + 1;
+                Write(reinterpret_cast<const char *>(&size), sizeof(uint32_t));
+            }
+            Write(str, out.length);
+            Write("", 1);
+            hashes.insert(pair<size_t, written_string>(hash, out));
+        }
+
+        directory.push_back(id);
+        directory.push_back(out.offset);
+        ids.insert(id);
+    } catch (...) {
+        failed = true;
+        throw;
+    }
+}
+
+//Writes the directory, then copies the string data from the temporary file.
+void _strings_writer_int::Finish() {
+    if (finished)
+        throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "The writer has already been finished.");
+    else if (failed)
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "An earlier write to \"" + dataPath + "\" failed.");
+
+    try {
+        Flush();
+
+        stat_timer timer(GlobalStats(), STAT_WRITE_TIME);
+        boost::iostreams::file_descriptor_sink out(fs::path(path), ios::binary | ios::trunc);
+        const uint32_t header[2] = { uint32_t(ids.size()), uint32_t(dataSize) };
+        const streamsize directorySize = directory.size() * sizeof(uint32_t);
+        if (out.write(reinterpret_cast<const char *>(header), sizeof(header)) != streamsize(sizeof(header))
+            || (directorySize > 0 && out.write(reinterpret_cast<const char *>(&directory[0]), directorySize) != directorySize))
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+
+        buffer.resize(bufferSize);
+        dataFile.seek(0, ios_base::beg);
+        for (uint64_t copied = 0; copied < dataSize;) {
+            const streamsize size = streamsize(min<uint64_t>(bufferSize, dataSize - copied));
+            if (dataFile.read(&buffer[0], size) != size)
+                throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not read back \"" + dataPath + "\".");
+            if (out.write(&buffer[0], size) != size)
+                throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+            copied += size;
+        }
+        out.close();
+        GlobalStats().Add(STAT_BYTES_WRITTEN, sizeof(header) + directorySize + dataSize);
+    } catch (ios_base::failure& e) {
+        failed = true;
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+    } catch (...) {
+        failed = true;
+        throw;
+    }
+
+    finished = true;
+    vector<char>().swap(buffer);
+}
+
+//Checks if a string that has been written is the given string, which has the same length.
+bool _strings_writer_int::Matches(const written_string& written, const char * str) {
+    const uint64_t pos = written.offset + (isDotStrings ? 0 : sizeof(uint32_t));
+    if (pos >= flushedSize)
+        return memcmp(&buffer[pos - flushedSize], str, written.length) == 0;
+
+    //The string is all in the temporary file, as it was added in one write.
+    vector<char> stored(written.length);
+    try {
+        dataFile.seek(pos, ios_base::beg);
+        const bool read = written.length == 0 || dataFile.read(&stored[0], written.length) == streamsize(written.length);
+        dataFile.seek(0, ios_base::end);
+        if (!read)
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not read back \"" + dataPath + "\".");
+    } catch (ios_base::failure& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not read back \"" + dataPath + "\".");
+    }
+    return written.length == 0 || memcmp(&stored[0], str, written.length) == 0;
+}
+
+void _strings_writer_int::Write(const char * data, const size_t length) {
+    if (buffer.size() + length > bufferSize)
+        Flush();
+
+    if (length > bufferSize) {
+        try {
+            if (dataFile.write(data, length) != streamsize(length))
+                throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + dataPath + "\".");
+        } catch (ios_base::failure& e) {
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + dataPath + "\".");
+        }
+        flushedSize += length;
+    } else
+        buffer.insert(buffer.end(), data, data + length);
+
+    dataSize += length;
+}
+
+void _strings_writer_int::Flush() {
+    if (buffer.empty())
+        return;
+
+    try {
+        if (dataFile.write(&buffer[0], buffer.size()) != streamsize(buffer.size()))
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + dataPath + "\".");
+    } catch (ios_base::failure& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + dataPath + "\".");
+    }
+    flushedSize += buffer.size();
+    buffer.clear();
+}
@@ -0,0 +1,86 @@
+/*      libstrings
+
+        A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+        This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public License
+        as published by the Free Software Foundation, either version 3 of
+        the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+        <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_WRITER_H__
+#define __LIBSTRINGS_WRITER_H__
+
+#include "libstrings.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/unordered_set.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/thread/mutex.hpp>
+
+/* Writes a strings file without holding its strings in memory. The string
+   data is written to a temporary file next to the output as strings are
+   added, and only the directory and the hashes of the strings written are
+   kept, so that strings shared between IDs are written once. The directory
+   comes before the string data in a strings file, so the output is only
+   written when the writer is finished, by copying the string data after it. */
+struct _strings_writer_int {
+public:
+    _strings_writer_int(const std::string& path, const std::string& encoding);
+    ~_strings_writer_int();  //Deletes the temporary file.
+
+    //Writer functions lock this, so that a writer can be shared between threads.
+    boost::mutex mutex;
+
+    void Add(const uint32_t id, const char * str, const size_t length);
+    void Finish();
+private:
+    //Where a string that has been written is in the string data.
+    struct written_string {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    std::string path;
+    std::string encoding;
+    bool isUTF8;
+    bool isDotStrings;
+    bool finished;
+    bool failed;  //Set if a write failed, after which the temporary file can't be trusted.
+
+    std::vector<uint32_t> directory;  //ID and offset pairs, in the order added.
+    boost::unordered_set<uint32_t> ids;
+    boost::unordered_multimap<size_t, written_string> hashes;
+
+    //The temporary file, and the string data that hasn't been written to it yet.
+    std::string dataPath;
+    boost::iostreams::file_descriptor dataFile;
+    std::vector<char> buffer;
+    uint64_t dataSize;      //Including what's in the buffer.
+    uint64_t flushedSize;   //Excluding what's in the buffer.
+
+    bool Matches(const written_string& written, const char * str);
+    void Write(const char * data, const size_t length);
+    void Flush();
+
+    //Not copyable.
+    _strings_writer_int(const _strings_writer_int&);
+    _strings_writer_int& operator = (const _strings_writer_int&);
+};
+
+#endif